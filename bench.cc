@@ -0,0 +1,273 @@
+#include <benchmark/benchmark.h>
+
+#include <chrono>
+#include <iterator>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <x86intrin.h>
+
+#include "chunk.hpp"
+#include "generator.hpp"
+#include "perf_counters.hpp"
+#include "result_merger.hpp"
+#include "scanner.hpp"
+#include "station_table.hpp"
+#include "temperature.hpp"
+#include "weather_stations.hpp"
+
+/*
+ * Micro-benchmarks of the hot path on in-memory input from generator.hpp:
+ * BENCH_ROWS rows over a given number of stations, followed by
+ * CHUNK_PADDING bytes like a mapped file. Every benchmark reports
+ *   ns/row         wall time per row (or per station for the merge stages)
+ *   bytes/cycle    input bytes per CPU cycle, TSC cycles without counters
+ * and, where perf_event_open offers them, cycles, instructions (IPC),
+ * branch, L1d, LLC and dTLB misses per row. bytes are those of the rows, or
+ * of the values or names where only those are read.
+ */
+
+constexpr uint64_t BENCH_ROWS = 1 << 20;
+
+/* \brief generated rows, cached per cardinality */
+struct Input {
+    /* size bytes of rows, then the padding */
+    std::string bytes;
+    size_t size;
+    /* name start, name length and value start of every row */
+    std::vector<const char *> names;
+    std::vector<uint32_t> lengths;
+    std::vector<const char *> values;
+
+    const char *begin() const { return bytes.data(); }
+    const char *end() const { return bytes.data() + size; }
+};
+
+const Input &input(uint32_t stations) {
+    static std::map<uint32_t, std::unique_ptr<Input>> inputs;
+    std::unique_ptr<Input> &in = inputs[stations];
+    if (in)
+        return *in;
+
+    GeneratorOptions opts;
+    opts.rows = BENCH_ROWS;
+    opts.stations = stations;
+    const Generator generator(opts);
+    in.reset(new Input);
+    std::string block(Generator::BLOCK_ROWS * Generator::MAX_ROW, '\0');
+    for (uint64_t b = 0; b < generator.blocks(); ++b)
+        in->bytes.append(block.data(), generator.fill(b, block.data()));
+    in->size = in->bytes.size();
+    in->bytes.append(CHUNK_PADDING, '\0');
+
+    scanRowsScalar(in->begin(), in->end(),
+                   [&](const char *name, size_t len, const char *value) {
+                       in->names.push_back(name);
+                       in->lengths.push_back(uint32_t(len));
+                       in->values.push_back(value);
+                   });
+    return *in;
+}
+
+/*
+ * \brief a table holding every station of in, as a worker ends up with:
+ * sized for the standard stations and grown from there
+ */
+PartialResult aggregate(const Input &in) {
+    PartialResult table(std::size(WEATHER_STATIONS));
+    for (size_t i = 0; i < in.names.size(); ++i)
+        table.find(in.names[i], in.lengths[i],
+                   makeNameKey(in.names[i], in.lengths[i])) +=
+            parseTemperature(in.values[i]);
+    return table;
+}
+
+/* \brief bytes of the station names in table */
+uint64_t nameBytes(const PartialResult &table) {
+    uint64_t bytes = 0;
+    for (const auto &[name, data] : table)
+        bytes += name.size();
+    return bytes;
+}
+
+/*
+ * \brief run body once per iteration and report the counters above, body
+ * handling rows rows (or stations) out of bytes bytes of input
+ */
+template <typename F>
+void measure(benchmark::State &state, uint64_t rows, uint64_t bytes,
+             F &&body) {
+    using Clock = std::chrono::steady_clock;
+    PerfCounters counters;
+    counters.enable();
+    const PerfSample before = counters.read();
+    const uint64_t tsc_before = __rdtsc();
+    const Clock::time_point start = Clock::now();
+    for (auto _ : state)
+        body();
+    const double ns =
+        std::chrono::duration<double, std::nano>(Clock::now() - start)
+            .count();
+    const uint64_t tsc = __rdtsc() - tsc_before;
+    const PerfSample sample = counters.read() - before;
+    counters.disable();
+
+    const double total_rows = double(rows) * state.iterations();
+    const double total_bytes = double(bytes) * state.iterations();
+    state.SetItemsProcessed(int64_t(total_rows));
+    state.SetBytesProcessed(int64_t(total_bytes));
+    state.counters["ns/row"] = ns / total_rows;
+
+    const bool cycles = counters.available(PerfEvent::Cycles);
+    state.counters["bytes/cycle"] =
+        total_bytes / double(cycles ? sample[PerfEvent::Cycles] : tsc);
+    if (cycles)
+        state.counters["cycles/row"] =
+            double(sample[PerfEvent::Cycles]) / total_rows;
+    if (cycles && counters.available(PerfEvent::Instructions))
+        state.counters["IPC"] = double(sample[PerfEvent::Instructions]) /
+                                double(sample[PerfEvent::Cycles]);
+    for (const PerfEvent event :
+         {PerfEvent::BranchMisses, PerfEvent::L1dMisses, PerfEvent::LlcMisses,
+          PerfEvent::DtlbMisses})
+        if (counters.available(event))
+            state.counters[std::string(perfEventName(event)) + "/row"] =
+                double(sample[event]) / total_rows;
+}
+
+void BM_ParseTemperature(benchmark::State &state) {
+    const Input &in = input(413);
+    uint64_t value_bytes = 0;
+    for (size_t i = 0; i < in.values.size(); ++i)
+        value_bytes += (i + 1 < in.names.size() ? in.names[i + 1] : in.end()) -
+                       in.values[i];
+    measure(state, in.values.size(), value_bytes, [&] {
+        int64_t sum = 0;
+        for (const char *value : in.values)
+            sum += parseTemperature(value);
+        benchmark::DoNotOptimize(sum);
+    });
+}
+BENCHMARK(BM_ParseTemperature);
+
+void BM_Scan(benchmark::State &state) {
+    const ScanIsa isa = ScanIsa(state.range(0));
+    if (isa > detectScanIsa()) {
+        state.SkipWithError("ISA not supported");
+        return;
+    }
+    state.SetLabel(scanIsaName(isa));
+    const Input &in = input(413);
+    measure(state, in.names.size(), in.size, [&] {
+        size_t len_sum = 0;
+        scanRows(isa, in.begin(), in.end(),
+                 [&](const char *, size_t len, const char *) {
+                     len_sum += len;
+                 });
+        benchmark::DoNotOptimize(len_sum);
+    });
+}
+BENCHMARK(BM_Scan)
+    ->Arg(int(ScanIsa::Scalar))
+    ->Arg(int(ScanIsa::Avx2))
+    ->Arg(int(ScanIsa::Avx512));
+
+/*
+ * name hashing: 0 keys every name with makeNameKey after the vector scan, 1
+ * builds the hash byte by byte inside a scalar scan for ';' instead
+ */
+void BM_NameHash(benchmark::State &state) {
+    const bool in_scan = state.range(0);
+    const ScanIsa isa = detectScanIsa();
+    state.SetLabel(in_scan ? "in-scan" : scanIsaName(isa));
+    const Input &in = input(413);
+    measure(state, in.names.size(), in.size, [&] {
+        uint64_t hashes = 0;
+        if (in_scan) {
+            for (const char *p = in.begin(); p < in.end();) {
+                uint64_t h = 0xCBF29CE484222325ull;
+                for (; *p != ';'; ++p)
+                    h = (h ^ uint8_t(*p)) * 0x100000001B3ull;
+                hashes += h;
+                p = static_cast<const char *>(
+                        memchr(p, '\n', size_t(in.end() - p))) +
+                    1;
+            }
+        } else {
+            scanRows(isa, in.begin(), in.end(),
+                     [&](const char *name, size_t len, const char *) {
+                         hashes += makeNameKey(name, len).hash;
+                     });
+        }
+        benchmark::DoNotOptimize(hashes);
+    });
+}
+BENCHMARK(BM_NameHash)->Arg(0)->Arg(1);
+
+/* name key and table lookup of every row, into a table already holding them */
+void BM_Lookup(benchmark::State &state) {
+    const Input &in = input(state.range(0));
+    PartialResult table = aggregate(in);
+    uint64_t name_bytes = 0;
+    for (const uint32_t len : in.lengths)
+        name_bytes += len;
+    measure(state, in.names.size(), name_bytes, [&] {
+        for (size_t i = 0; i < in.names.size(); ++i)
+            ++table.find(in.names[i], in.lengths[i],
+                         makeNameKey(in.names[i], in.lengths[i]))
+                  .occurences;
+    });
+}
+BENCHMARK(BM_Lookup)->Arg(413)->Arg(10'000)->Arg(100'000)->Arg(1'000'000);
+
+/* the whole row path of a worker: scan, key, lookup, parse, accumulate */
+void BM_Aggregate(benchmark::State &state) {
+    const Input &in = input(state.range(0));
+    const ScanIsa isa = detectScanIsa();
+    state.SetLabel(scanIsaName(isa));
+    PartialResult table = aggregate(in);
+    measure(state, in.names.size(), in.size, [&] {
+        scanRows(isa, in.begin(), in.end(),
+                 [&](const char *name, size_t len, const char *value) {
+                     table.find(name, len, makeNameKey(name, len)) +=
+                         parseTemperature(value);
+                 });
+    });
+}
+BENCHMARK(BM_Aggregate)->Arg(413)->Arg(10'000)->Arg(100'000)->Arg(1'000'000);
+
+/* folding one worker's table into another holding the same stations */
+void BM_CombinePartialResult(benchmark::State &state) {
+    const Input &in = input(state.range(0));
+    PartialResult lhs = aggregate(in);
+    const PartialResult rhs = aggregate(in);
+    measure(state, rhs.size(), nameBytes(rhs),
+            [&] { combinePartialResult(lhs, rhs); });
+}
+BENCHMARK(BM_CombinePartialResult)
+    ->Arg(413)
+    ->Arg(10'000)
+    ->Arg(100'000)
+    ->Arg(1'000'000);
+
+/* collecting and sorting the final table, on one thread */
+void BM_GetOrderedResult(benchmark::State &state) {
+    const Input &in = input(state.range(0));
+    const PartialResult table = aggregate(in);
+    measure(state, table.size(), nameBytes(table), [&] {
+        Result result = getOrderedResult({&table, 1}, 1);
+        benchmark::DoNotOptimize(result.data());
+    });
+}
+BENCHMARK(BM_GetOrderedResult)
+    ->Arg(413)
+    ->Arg(10'000)
+    ->Arg(100'000)
+    ->Arg(1'000'000);
+
+BENCHMARK_MAIN();
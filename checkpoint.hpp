@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "partial_file.hpp"
+#include "result_merger.hpp"
+
+/*
+ * State of an incremental run over an append-only input: the identity of
+ * the file, the offset just past its last complete row and the aggregate
+ * of every row before it. A later run only aggregates the bytes after
+ * offset and folds them in.
+ *
+ * Layout: "1BRCCKPT", uint32 version, uint64 device, uint64 inode,
+ * uint64 offset, then the aggregate as a partial file.
+ */
+struct Checkpoint {
+    static constexpr char MAGIC[8] = {'1', 'B', 'R', 'C', 'C', 'K', 'P', 'T'};
+    static constexpr uint32_t VERSION = 1;
+    static constexpr size_t HEADER_SIZE = sizeof(MAGIC) + 4 + 3 * 8;
+
+    uint64_t dev = 0, ino = 0;
+    uint64_t offset = 0;
+    PartialResult result;
+};
+
+/* \brief false, leaving ckpt untouched, if there is no valid checkpoint */
+inline bool loadCheckpoint(const std::string &path, Checkpoint &ckpt) {
+    std::string bytes;
+    if (!readFile(path, bytes) || bytes.size() < Checkpoint::HEADER_SIZE ||
+        memcmp(bytes.data(), Checkpoint::MAGIC, sizeof(Checkpoint::MAGIC)))
+        return false;
+    const char *p = bytes.data() + sizeof(Checkpoint::MAGIC);
+    uint32_t version;
+    Checkpoint loaded;
+    p = partial::get(p, version);
+    p = partial::get(p, loaded.dev);
+    p = partial::get(p, loaded.ino);
+    p = partial::get(p, loaded.offset);
+    if (version != Checkpoint::VERSION ||
+        !decodePartial(std::string_view(bytes).substr(Checkpoint::HEADER_SIZE),
+                       loaded.result))
+        return false;
+    ckpt = std::move(loaded);
+    return true;
+}
+
+inline bool saveCheckpoint(const std::string &path, const Checkpoint &ckpt) {
+    char header[Checkpoint::HEADER_SIZE];
+    memcpy(header, Checkpoint::MAGIC, sizeof(Checkpoint::MAGIC));
+    char *p = header + sizeof(Checkpoint::MAGIC);
+    p = partial::put(p, Checkpoint::VERSION);
+    p = partial::put(p, ckpt.dev);
+    p = partial::put(p, ckpt.ino);
+    partial::put(p, ckpt.offset);
+    return replaceFile(path, {std::string_view(header, sizeof(header)),
+                              encodePartial({&ckpt.result, 1})});
+}
@@ -1,6 +1,21 @@
 #pragma once
 
 #include <cstddef>
+#include <string.h>
+
+/*
+ * Row ownership: a chunk owns exactly the rows that start inside it, where a
+ * row starts at the beginning of the input or right after a '\n'. Producers
+ * cut chunks on row starts (see nextRowStart), so a chunk is a whole number
+ * of rows and only the last chunk of an input may end in an unterminated
+ * row.
+ *
+ * Hot loops use fixed-width loads (8-byte temperature words, 16-byte name
+ * prefixes), so at least CHUNK_PADDING readable bytes must follow the end of
+ * any chunk; inside a buffer these are simply the next rows, at the end of
+ * an input the buffer provides zeroed padding.
+ */
+constexpr size_t CHUNK_PADDING = 64;
 
 struct Chunk {
     const char * data;
@@ -10,3 +25,14 @@ struct Chunk {
         return data == rhs.data && size == rhs.size;
     }
 };
+
+/* \brief start of the first row at or after p within [begin, end] */
+inline const char *nextRowStart(const char *p, const char *begin,
+                                const char *end) {
+    if (p <= begin)
+        return begin;
+    if (p >= end)
+        return end;
+    const void *nl = memchr(p - 1, '\n', end - (p - 1));
+    return nl ? static_cast<const char *>(nl) + 1 : end;
+}
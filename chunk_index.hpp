@@ -0,0 +1,290 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <utility>
+#include <vector>
+
+#include "chunk.hpp"
+#include "partial_file.hpp"
+#include "result_merger.hpp"
+#include "unordered_dense.hpp"
+
+/*
+ * Sidecar index of a single input: row-aligned chunk offsets, so a later
+ * run splits the work without searching for row starts, and the set of
+ * stations present in each chunk over a station dictionary, so a query for
+ * a few stations only reads the chunks that contain them.
+ *
+ * The index is built by the first run: chunks of about CHUNK bytes are cut
+ * up front and every worker reports the stations of the chunks it
+ * aggregated through record(). It describes the input by device, inode,
+ * size and mtime and is rebuilt whenever any of them changes.
+ *
+ * A station set is stored as a bitmap of one bit per station, or as the
+ * sorted station ids when that is smaller, so the size of the index follows
+ * the number of (chunk, station) pairs instead of chunks x stations.
+ *
+ * Layout (little-endian):
+ *   header   "1BRCINDX", uint32 version, uint64 device, inode, size,
+ *            mtime seconds, mtime nanoseconds, chunk count, station count,
+ *            string table size, set word count
+ *   offsets  (chunk count + 1) x uint64, the chunk boundaries
+ *   stations station count x { uint64 name offset, uint32 name length }
+ *   sets     (chunk count + 1) x uint64, the start of each chunk's set in
+ *            the words; a set of (station count + 31) / 32 words is a
+ *            bitmap, a shorter one the sorted ids
+ *   words    set word count x uint32
+ *   strings  the station names
+ */
+class ChunkIndex {
+  public:
+    static constexpr size_t CHUNK = 4 * 1024 * 1024;
+    static constexpr char MAGIC[8] = {'1', 'B', 'R', 'C', 'I', 'N', 'D', 'X'};
+    static constexpr uint32_t VERSION = 2;
+    static constexpr size_t HEADER_SIZE = sizeof(MAGIC) + 4 + 9 * 8;
+    static constexpr size_t STATION_SIZE = 8 + 4;
+
+    /* \brief a new index for the mapped input [begin, begin + size) */
+    ChunkIndex(const struct stat &st, const char *begin, size_t size)
+        : identity(identify(st)) {
+        const char *end = begin + size;
+        offsets.push_back(0);
+        for (const char *itr = begin; itr < end;) {
+            itr = nextRowStart(itr + CHUNK, begin, end);
+            offsets.push_back(itr - begin);
+        }
+        chunk_ids.resize(chunks());
+    }
+
+    /* \brief the index at path if it is one for the input described by st */
+    static std::unique_ptr<ChunkIndex> load(const std::string &path,
+                                            const struct stat &st) {
+        std::string bytes;
+        if (!readFile(path, bytes) || bytes.size() < HEADER_SIZE ||
+            memcmp(bytes.data(), MAGIC, sizeof(MAGIC)) != 0)
+            return nullptr;
+        const char *p = bytes.data() + sizeof(MAGIC);
+        uint32_t version;
+        Identity id;
+        uint64_t n_chunks, n_stations, names_size, n_words;
+        p = partial::get(p, version);
+        p = partial::get(p, id);
+        p = partial::get(p, n_chunks);
+        p = partial::get(p, n_stations);
+        p = partial::get(p, names_size);
+        p = partial::get(p, n_words);
+        /* bound the counts by the file size before multiplying them */
+        if (version != VERSION || id != identify(st) ||
+            n_chunks > bytes.size() || n_stations > bytes.size() ||
+            n_words > bytes.size() ||
+            bytes.size() != HEADER_SIZE + (n_chunks + 1) * 16 +
+                                n_stations * STATION_SIZE + n_words * 4 +
+                                names_size)
+            return nullptr;
+
+        std::unique_ptr<ChunkIndex> index(new ChunkIndex(id));
+        index->n_stations = n_stations;
+        index->offsets.resize(n_chunks + 1);
+        for (uint64_t &offset : index->offsets)
+            p = partial::get(p, offset);
+        if (!ascending(index->offsets, 0, id.size))
+            return nullptr;
+        const char *strings = bytes.data() + bytes.size() - names_size;
+        for (uint64_t i = 0; i < n_stations; ++i) {
+            uint64_t offset;
+            uint32_t len;
+            p = partial::get(partial::get(p, offset), len);
+            if (offset > names_size || len > names_size - offset)
+                return nullptr;
+            index->dictionary.emplace(std::string(strings + offset, len),
+                                      uint32_t(i));
+        }
+        index->set_starts.resize(n_chunks + 1);
+        for (uint64_t &start : index->set_starts)
+            p = partial::get(p, start);
+        if (!ascending(index->set_starts, 0, n_words))
+            return nullptr;
+        index->words.resize(n_words);
+        memcpy(index->words.data(), p, n_words * 4);
+        for (size_t i = 0; i < n_chunks; ++i)
+            if (index->set_starts[i + 1] - index->set_starts[i] >
+                index->bitmapWords())
+                return nullptr;
+        return index;
+    }
+
+    size_t chunks() const { return offsets.size() - 1; }
+
+    Chunk chunk(const char *base, size_t i) const {
+        return {base + offsets[i], size_t(offsets[i + 1] - offsets[i])};
+    }
+
+    /* \brief the chunk starting at offset */
+    size_t chunkAt(uint64_t offset) const {
+        return std::upper_bound(offsets.begin(), offsets.end(), offset) -
+               offsets.begin() - 1;
+    }
+
+    /* \brief while building: chunk i holds the stations of table */
+    void record(size_t i, const PartialResult &table) {
+        std::vector<uint32_t> &ids = chunk_ids[i];
+        ids.reserve(table.size());
+        std::lock_guard<std::mutex> lock(mtx);
+        for (const auto &[name, data] : table)
+            ids.push_back(
+                dictionary.emplace(std::string(name), dictionary.size())
+                    .first->second);
+    }
+
+    /* \brief pack the recorded stations into sets and write the index */
+    bool save(const std::string &path) {
+        n_stations = dictionary.size();
+        set_starts.assign(1, 0);
+        words.clear();
+        for (std::vector<uint32_t> &ids : chunk_ids) {
+            if (ids.size() < bitmapWords()) {
+                std::sort(ids.begin(), ids.end());
+                words.insert(words.end(), ids.begin(), ids.end());
+            } else {
+                const size_t start = words.size();
+                words.resize(start + bitmapWords());
+                for (const uint32_t id : ids)
+                    words[start + id / 32] |= uint32_t(1) << (id % 32);
+            }
+            set_starts.push_back(words.size());
+        }
+
+        std::vector<std::string_view> names(dictionary.size());
+        size_t names_size = 0;
+        for (const auto &[name, id] : dictionary) {
+            names[id] = name;
+            names_size += name.size();
+        }
+
+        std::string out(HEADER_SIZE + offsets.size() * 8 +
+                            names.size() * STATION_SIZE +
+                            set_starts.size() * 8 + words.size() * 4,
+                        '\0');
+        char *p = out.data();
+        memcpy(p, MAGIC, sizeof(MAGIC));
+        p += sizeof(MAGIC);
+        p = partial::put(p, VERSION);
+        p = partial::put(p, identity);
+        p = partial::put(p, uint64_t(chunks()));
+        p = partial::put(p, uint64_t(names.size()));
+        p = partial::put(p, uint64_t(names_size));
+        p = partial::put(p, uint64_t(words.size()));
+        for (const uint64_t offset : offsets)
+            p = partial::put(p, offset);
+        uint64_t offset = 0;
+        for (const std::string_view name : names) {
+            p = partial::put(p, offset);
+            p = partial::put(p, uint32_t(name.size()));
+            offset += name.size();
+        }
+        for (const uint64_t start : set_starts)
+            p = partial::put(p, start);
+        memcpy(p, words.data(), words.size() * 4);
+
+        std::vector<std::string_view> parts = {out};
+        parts.insert(parts.end(), names.begin(), names.end());
+        return replaceFile(path, parts);
+    }
+
+    /* \brief ids of those of names that occur in the input */
+    std::vector<uint32_t> stationIds(const std::vector<std::string> &names)
+        const {
+        std::vector<uint32_t> ids;
+        for (const std::string &name : names)
+            if (const auto it = dictionary.find(name); it != dictionary.end())
+                ids.push_back(it->second);
+        return ids;
+    }
+
+    /* \brief whether chunk i holds any of the stations ids */
+    bool contains(size_t i, const std::vector<uint32_t> &ids) const {
+        const uint32_t *set = words.data() + set_starts[i];
+        const uint32_t *set_end = words.data() + set_starts[i + 1];
+        const bool bitmap = size_t(set_end - set) == bitmapWords();
+        for (const uint32_t id : ids)
+            if (bitmap ? set[id / 32] >> (id % 32) & 1
+                       : std::binary_search(set, set_end, id))
+                return true;
+        return false;
+    }
+
+  private:
+    struct Identity {
+        uint64_t dev, ino, size;
+        int64_t mtime_sec, mtime_nsec;
+
+        bool operator==(const Identity &) const = default;
+    };
+
+    explicit ChunkIndex(const Identity &identity) : identity(identity) {}
+
+    /* \brief whether values never decrease and run from first to last */
+    static bool ascending(const std::vector<uint64_t> &values,
+                          uint64_t first, uint64_t last) {
+        return values.front() == first && values.back() == last &&
+               std::is_sorted(values.begin(), values.end());
+    }
+
+    size_t bitmapWords() const { return (n_stations + 31) / 32; }
+
+    static Identity identify(const struct stat &st) {
+        return {uint64_t(st.st_dev), uint64_t(st.st_ino), uint64_t(st.st_size),
+                int64_t(st.st_mtim.tv_sec), int64_t(st.st_mtim.tv_nsec)};
+    }
+
+    Identity identity;
+    std::vector<uint64_t> offsets;
+    size_t n_stations = 0;
+    /* the station set of chunk i is words[set_starts[i], set_starts[i + 1]) */
+    std::vector<uint64_t> set_starts;
+    std::vector<uint32_t> words;
+    ankerl::unordered_dense::map<std::string, uint32_t> dictionary;
+    /* while building: the station ids of every chunk */
+    std::vector<std::vector<uint32_t>> chunk_ids;
+    std::mutex mtx;
+};
+
+/*
+ * Work source of the run that builds a ChunkIndex: hands out the index's
+ * chunks in order, and consumerThread reports the stations of each one
+ * back through record().
+ */
+class IndexBuilder {
+  public:
+    IndexBuilder(ChunkIndex &index, const char *base)
+        : index(index), base(base) {}
+
+    IndexBuilder(const IndexBuilder &) = delete;
+    IndexBuilder &operator=(const IndexBuilder &) = delete;
+
+    std::optional<Chunk> pop() {
+        const size_t i = next.fetch_add(1, std::memory_order_relaxed);
+        if (i >= index.chunks())
+            return std::nullopt;
+        return index.chunk(base, i);
+    }
+
+    void record(const Chunk &chunk, const PartialResult &stations) {
+        index.record(index.chunkAt(chunk.data - base), stations);
+    }
+
+  private:
+    ChunkIndex &index;
+    const char *base;
+    std::atomic<size_t> next{0};
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "chunk.hpp"
+#include "ring_queue.hpp"
+
+/*
+ * Queue-free work distribution: the input buffers are cut up front, on row
+ * starts, into a guided schedule (each chunk is a fixed fraction of what is
+ * left over all buffers, clamped to [min_chunk, max_chunk]), so chunks are
+ * large at the start and shrink towards the end and all workers run out of
+ * work at about the same time. Chunks never span two buffers. Workers claim
+ * the next chunk with a single fetch_add; pop() has the same shape as the
+ * queues so consumerThread can take either.
+ */
+class ChunkSchedule {
+  public:
+    /* each chunk covers 1 / (GUIDED_FACTOR * n_workers) of what remains */
+    static constexpr size_t GUIDED_FACTOR = 4;
+    static constexpr size_t DEFAULT_MAX_CHUNK = 32 * 1024 * 1024;
+
+    ChunkSchedule(const std::vector<Chunk> &buffers, uint32_t n_workers,
+                  size_t min_chunk, size_t max_chunk = DEFAULT_MAX_CHUNK) {
+        const size_t divisor = GUIDED_FACTOR * std::max(n_workers, 1u);
+        size_t remaining = 0;
+        for (const Chunk &buffer : buffers)
+            remaining += buffer.size;
+        for (const Chunk &buffer : buffers) {
+            const char *begin = buffer.data;
+            const char *end = buffer.data + buffer.size;
+            for (const char *itr = begin; itr < end;) {
+                const size_t size = std::min(
+                    size_t(end - itr),
+                    std::clamp(remaining / divisor, min_chunk, max_chunk));
+                const char *next = nextRowStart(itr + size, begin, end);
+                chunks.push_back({itr, size_t(next - itr)});
+                remaining -= next - itr;
+                itr = next;
+            }
+        }
+    }
+
+    /* \brief chunks cut elsewhere, e.g. read from a ChunkIndex */
+    explicit ChunkSchedule(std::vector<Chunk> chunks)
+        : chunks(std::move(chunks)) {}
+
+    ChunkSchedule(const ChunkSchedule &) = delete;
+    ChunkSchedule &operator=(const ChunkSchedule &) = delete;
+
+    std::optional<Chunk> pop() {
+        const size_t i = next.fetch_add(1, std::memory_order_relaxed);
+        if (i >= chunks.size())
+            return std::nullopt;
+        return chunks[i];
+    }
+
+    size_t size() const { return chunks.size(); }
+
+  private:
+    std::vector<Chunk> chunks;
+    alignas(CACHE_LINE) std::atomic<size_t> next{0};
+};
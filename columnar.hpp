@@ -0,0 +1,309 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <fcntl.h>
+#include <immintrin.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+
+#include "data.hpp"
+#include "io_util.hpp"
+#include "mmap_file.hpp"
+
+/*
+ * Columnar form of a measurements file, written by the convert command and
+ * aggregated without any parsing: a dictionary of the station names and two
+ * columns, the station id of every row (uint16, or uint32 past 65536
+ * stations) and its temperature in tenths (int16). Both columns start on an
+ * ALIGN boundary and are split into blocks of BLOCK_ROWS rows, the unit of
+ * work of the engine. Blocks carry no min/max: every aggregate reads every
+ * row, so such stats could never let the engine skip a block.
+ *
+ * Layout (little-endian):
+ *   ColumnarHeader
+ *   dictionary  stations x { uint64 name offset, uint32 name length,
+ *               uint32 zero }
+ *   names       the station names, back to back
+ *   ids         rows x id_width bytes, at ids_offset
+ *   temps       rows x int16, at temps_offset
+ */
+namespace columnar {
+
+constexpr char MAGIC[8] = {'1', 'B', 'R', 'C', 'C', 'O', 'L', 'S'};
+constexpr uint32_t VERSION = 2;
+constexpr size_t ALIGN = 4096;
+constexpr size_t BLOCK_ROWS = 64 * 1024;
+constexpr size_t RECORD_SIZE = 16;
+
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t id_width;
+    uint64_t rows, stations, blocks;
+    uint64_t names_offset, names_size;
+    uint64_t ids_offset, temps_offset, file_size;
+};
+static_assert(sizeof(Header) == 80);
+
+inline size_t alignUp(size_t n) { return (n + ALIGN - 1) / ALIGN * ALIGN; }
+
+/* \brief header with every offset filled in */
+inline Header layout(uint64_t rows, uint64_t stations, uint64_t names_size) {
+    Header h = {};
+    memcpy(h.magic, MAGIC, sizeof(MAGIC));
+    h.version = VERSION;
+    h.id_width = stations <= 65536 ? 2 : 4;
+    h.rows = rows;
+    h.stations = stations;
+    h.blocks = (rows + BLOCK_ROWS - 1) / BLOCK_ROWS;
+    h.names_offset = sizeof(Header) + stations * RECORD_SIZE;
+    h.names_size = names_size;
+    h.ids_offset = alignUp(h.names_offset + names_size);
+    h.temps_offset = alignUp(h.ids_offset + rows * h.id_width);
+    h.file_size = h.temps_offset + rows * sizeof(int16_t);
+    return h;
+}
+
+} // namespace columnar
+
+/* \brief whether the file at path starts with the columnar magic */
+inline bool isColumnar(const char *path) {
+    const int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return false;
+    char magic[sizeof(columnar::MAGIC)];
+    const size_t n = preadFull(fd, magic, sizeof(magic), 0);
+    close(fd);
+    return n == sizeof(magic) &&
+           memcmp(magic, columnar::MAGIC, sizeof(magic)) == 0;
+}
+
+/*
+ * \brief a new columnar file of known shape, mapped writable; the caller
+ * fills in the columns
+ */
+class ColumnarWriter {
+  public:
+    ColumnarWriter(const char *path, uint64_t rows,
+                   const std::vector<std::string_view> &names) {
+        size_t names_size = 0;
+        for (const std::string_view name : names)
+            names_size += name.size();
+        header = columnar::layout(rows, names.size(), names_size);
+
+        fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd == -1 || ftruncate(fd, header.file_size) == -1) {
+            perror(path);
+            exit(1);
+        }
+        base = static_cast<char *>(mmap(nullptr, header.file_size,
+                                        PROT_READ | PROT_WRITE, MAP_SHARED,
+                                        fd, 0));
+        if (base == MAP_FAILED) {
+            perror("mmap");
+            exit(1);
+        }
+
+        memcpy(base, &header, sizeof(header));
+        char *record = base + sizeof(header);
+        char *strings = base + header.names_offset;
+        uint64_t offset = 0;
+        for (const std::string_view name : names) {
+            const uint32_t len = name.size();
+            memcpy(record, &offset, 8);
+            memcpy(record + 8, &len, 4);
+            memcpy(strings + offset, name.data(), len);
+            record += columnar::RECORD_SIZE;
+            offset += len;
+        }
+    }
+
+    ~ColumnarWriter() {
+        if (munmap(base, header.file_size) == -1 || close(fd) == -1) {
+            perror("columnar output");
+            exit(1);
+        }
+    }
+
+    ColumnarWriter(const ColumnarWriter &) = delete;
+    ColumnarWriter &operator=(const ColumnarWriter &) = delete;
+
+    uint32_t idWidth() const { return header.id_width; }
+
+    /* \brief set the id and temperature of row i */
+    void put(uint64_t i, uint32_t id, int16_t temp) {
+        if (header.id_width == 2) {
+            const uint16_t narrow = id;
+            memcpy(base + header.ids_offset + 2 * i, &narrow, 2);
+        } else {
+            memcpy(base + header.ids_offset + 4 * i, &id, 4);
+        }
+        memcpy(base + header.temps_offset + 2 * i, &temp, 2);
+    }
+
+  private:
+    columnar::Header header;
+    int fd;
+    char *base;
+};
+
+/* \brief a mapped, validated columnar file */
+class ColumnarFile {
+  public:
+    explicit ColumnarFile(const char *path, MapPolicy policy)
+        : file(path, policy) {
+        if (file.size() < sizeof(header)) {
+            fprintf(stderr, "%s: truncated columnar file\n", path);
+            exit(1);
+        }
+        memcpy(&header, file.begin(), sizeof(header));
+        /* bound the counts by the file size before laying them out */
+        if (header.stations > file.size() || header.names_size > file.size() ||
+            header.rows > file.size()) {
+            fprintf(stderr, "%s: corrupt columnar file\n", path);
+            exit(1);
+        }
+        const columnar::Header expected = columnar::layout(
+            header.rows, header.stations, header.names_size);
+        if (header.version != columnar::VERSION ||
+            memcmp(&header, &expected, sizeof(header)) != 0 ||
+            file.size() != header.file_size) {
+            fprintf(stderr, "%s: corrupt columnar file\n", path);
+            exit(1);
+        }
+        const char *record = file.begin() + sizeof(header);
+        for (uint64_t i = 0; i < header.stations;
+             ++i, record += columnar::RECORD_SIZE) {
+            uint64_t offset;
+            uint32_t len;
+            memcpy(&offset, record, 8);
+            memcpy(&len, record + 8, 4);
+            if (offset > header.names_size ||
+                len > header.names_size - offset) {
+                fprintf(stderr, "%s: corrupt columnar file\n", path);
+                exit(1);
+            }
+            names.emplace_back(file.begin() + header.names_offset + offset,
+                               len);
+        }
+    }
+
+    uint64_t rows() const { return header.rows; }
+    uint64_t blocks() const { return header.blocks; }
+    uint32_t idWidth() const { return header.id_width; }
+    const std::vector<std::string_view> &stations() const { return names; }
+
+    const void *ids() const { return file.begin() + header.ids_offset; }
+    const int16_t *temps() const {
+        return reinterpret_cast<const int16_t *>(file.begin() +
+                                                 header.temps_offset);
+    }
+
+  private:
+    MMapFile file;
+    columnar::Header header;
+    std::vector<std::string_view> names;
+};
+
+namespace detail {
+
+static_assert(sizeof(Data) == 16 && offsetof(Data, occurences) == 8 &&
+                  offsetof(Data, min) == 12 && offsetof(Data, max) == 14,
+              "the AVX-512 column kernel updates Data as two 64-bit words");
+
+/*
+ * Eight rows per step: the Data of each row's station is gathered as two
+ * 64-bit words, {sum} and {count, min, max}, updated in registers and
+ * scattered back. Conflict detection finds steps in which a station occurs
+ * twice, whose updates would be lost in the scatter; those steps go
+ * through the scalar loop instead.
+ */
+template <typename Id>
+__attribute__((target("avx512f,avx512bw,avx512cd"))) inline size_t
+aggregateColumnsAvx512(const Id *ids, const int16_t *temps, size_t n,
+                       Data *data) {
+    constexpr size_t STEP = 8;
+    /* count is the low dword, min and max words 2 and 3 of the second word */
+    const __mmask32 min_words = 0x44444444, max_words = 0x88888888;
+    const __m512i one = _mm512_set1_epi64(1);
+    long long *sums = reinterpret_cast<long long *>(data);
+    long long *rest = sums + 1;
+
+    size_t i = 0;
+    for (; i + STEP <= n; i += STEP) {
+        __m512i id;
+        if constexpr (sizeof(Id) == 2)
+            id = _mm512_cvtepu16_epi64(
+                _mm_loadu_si128(reinterpret_cast<const __m128i *>(ids + i)));
+        else
+            id = _mm512_cvtepu32_epi64(
+                _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ids + i)));
+        const __m512i conflicts = _mm512_conflict_epi64(id);
+        if (_mm512_test_epi64_mask(conflicts, conflicts)) {
+            for (size_t j = i; j < i + STEP; ++j)
+                data[ids[j]] += temps[j];
+            continue;
+        }
+
+        const __m512i t = _mm512_cvtepi16_epi64(
+            _mm_loadu_si128(reinterpret_cast<const __m128i *>(temps + i)));
+        const __m512i slot = _mm512_slli_epi64(id, 1);
+        const __m512i sum = _mm512_add_epi64(
+            _mm512_i64gather_epi64(slot, sums, 8), t);
+        /* the temperature in words 2 and 3 of every lane */
+        const __m512i t16 = _mm512_and_si512(t, _mm512_set1_epi64(0xFFFF));
+        const __m512i tt = _mm512_or_si512(_mm512_slli_epi64(t16, 32),
+                                           _mm512_slli_epi64(t16, 48));
+        __m512i other = _mm512_add_epi64(
+            _mm512_i64gather_epi64(slot, rest, 8), one);
+        other = _mm512_mask_min_epi16(other, min_words, other, tt);
+        other = _mm512_mask_max_epi16(other, max_words, other, tt);
+        _mm512_i64scatter_epi64(sums, slot, sum, 8);
+        _mm512_i64scatter_epi64(rest, slot, other, 8);
+    }
+    return i;
+}
+
+} // namespace detail
+
+/*
+ * \brief fold n rows of the columns into data, indexed by station id; the
+ * AVX-512 kernel only if avx512 is set
+ */
+template <typename Id>
+inline void aggregateColumns(const Id *ids, const int16_t *temps, size_t n,
+                             Data *data, bool avx512) {
+    size_t i = 0;
+    if (avx512)
+        i = detail::aggregateColumnsAvx512(ids, temps, n, data);
+    for (; i < n; ++i)
+        data[ids[i]] += temps[i];
+}
+
+/*
+ * \brief whether all n ids are below limit, so aggregateColumns stays in
+ * a data array of limit entries; a max-reduce the compiler vectorizes
+ */
+template <typename Id>
+inline bool idsBelow(const Id *ids, size_t n, uint64_t limit) {
+    Id max = 0;
+    for (size_t i = 0; i < n; ++i)
+        max = std::max(max, ids[i]);
+    return max < limit;
+}
+
+/* \brief whether aggregateColumns can use its AVX-512 kernel */
+inline bool hasColumnKernelAvx512() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512f") &&
+           __builtin_cpu_supports("avx512bw") &&
+           __builtin_cpu_supports("avx512cd");
+}
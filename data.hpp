@@ -4,22 +4,37 @@
 #include <cstdint>
 #include <limits>
 
+/*
+ * Temperatures are kept as fixed-point tenths of a degree; conversion to a
+ * decimal only happens when printing, so aggregation is exact.
+ */
 struct Data {
-    float min = std::numeric_limits<float>::max(),
-          max = std::numeric_limits<float>::min(), sum = 0;
+    int64_t sum = 0;
     uint32_t occurences = 0;
+    int16_t min = std::numeric_limits<int16_t>::max(),
+            max = std::numeric_limits<int16_t>::min();
 
-    void operator+=(const Data& rhs) {
+    void operator+=(const Data &rhs) {
         min = std::min(min, rhs.min);
         max = std::max(max, rhs.max);
         sum += rhs.sum;
         occurences += rhs.occurences;
     }
 
-    void operator+=(const float val) {
+    void operator+=(const int16_t val) {
         min = std::min(min, val);
         max = std::max(max, val);
         sum += val;
         ++occurences;
     }
+
+    /*
+     * \brief mean in tenths, rounded half up like the reference
+     * implementation (floor((sum + count / 2) / count) on exact integers)
+     */
+    int64_t mean() const {
+        const int64_t num = 2 * sum + occurences;
+        const int64_t den = 2 * int64_t(occurences);
+        return num / den - (num % den < 0);
+    }
 };
@@ -0,0 +1,458 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <errno.h>
+#include <fcntl.h>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#ifdef ONEBRC_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef ONEBRC_HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef ONEBRC_HAVE_LZ4
+#include <lz4frame.h>
+#endif
+
+/*
+ * Compressed inputs, recognised by their magic bytes. Each codec is only
+ * available when the build found its library (see CMakeLists.txt); a
+ * compressed input without codec support is an error, never parsed as text.
+ */
+enum class Compression { None, Gzip, Zstd, Lz4 };
+
+constexpr size_t MAGIC_LENGTH = 4;
+
+inline Compression detectCompression(std::string_view head) {
+    const auto *u = reinterpret_cast<const unsigned char *>(head.data());
+    if (head.size() >= 2 && u[0] == 0x1F && u[1] == 0x8B)
+        return Compression::Gzip;
+    if (head.size() >= 4) {
+        uint32_t magic;
+        memcpy(&magic, head.data(), sizeof(magic));
+        if (magic == 0xFD2FB528)
+            return Compression::Zstd;
+        if (magic == 0x184D2204)
+            return Compression::Lz4;
+    }
+    return Compression::None;
+}
+
+/* \brief compression of a regular file, from its first bytes */
+inline Compression detectCompression(const char *path) {
+    const int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        perror("open");
+        exit(1);
+    }
+    char magic[MAGIC_LENGTH];
+    const ssize_t n = pread(fd, magic, sizeof(magic), 0);
+    close(fd);
+    return detectCompression(std::string_view(magic, n > 0 ? size_t(n) : 0));
+}
+
+inline const char *compressionName(Compression compression) {
+    switch (compression) {
+    case Compression::Gzip:
+        return "gzip";
+    case Compression::Zstd:
+        return "zstd";
+    case Compression::Lz4:
+        return "lz4";
+    default:
+        return "none";
+    }
+}
+
+/* \brief front-to-back byte stream; read() only comes up short at the end */
+class ByteSource {
+  public:
+    virtual ~ByteSource() = default;
+    virtual size_t read(char *buf, size_t len) = 0;
+};
+
+/* \brief a file descriptor, with lookahead for magic detection */
+class FdSource : public ByteSource {
+  public:
+    explicit FdSource(int fd) : fd(fd) {}
+
+    /* \brief the first n bytes (fewer at EOF), still to be read */
+    std::string_view peek(size_t n) {
+        while (lookahead.size() < n) {
+            const size_t have = lookahead.size();
+            lookahead.resize(n);
+            const size_t got = readFd(lookahead.data() + have, n - have);
+            lookahead.resize(have + got);
+            if (got == 0)
+                break;
+        }
+        return std::string_view(lookahead).substr(0, n);
+    }
+
+    size_t read(char *buf, size_t len) override {
+        size_t n = lookahead.size() - consumed < len
+                       ? lookahead.size() - consumed
+                       : len;
+        memcpy(buf, lookahead.data() + consumed, n);
+        consumed += n;
+        while (n < len) {
+            const size_t got = readFd(buf + n, len - n);
+            if (got == 0)
+                break;
+            n += got;
+        }
+        return n;
+    }
+
+  private:
+    size_t readFd(char *buf, size_t len) {
+        while (true) {
+            const ssize_t n = ::read(fd, buf, len);
+            if (n >= 0)
+                return size_t(n);
+            if (errno != EINTR) {
+                perror("read");
+                exit(1);
+            }
+        }
+    }
+
+    int fd;
+    std::string lookahead;
+    size_t consumed = 0;
+};
+
+/* \brief a byte range in memory, e.g. one frame of a mapped file */
+class MemorySource : public ByteSource {
+  public:
+    MemorySource(const char *data, size_t size) : data(data), size(size) {}
+
+    size_t read(char *buf, size_t len) override {
+        const size_t n = size - pos < len ? size - pos : len;
+        memcpy(buf, data + pos, n);
+        pos += n;
+        return n;
+    }
+
+  private:
+    const char *data;
+    size_t size;
+    size_t pos = 0;
+};
+
+/*
+ * \brief streaming decompressor: pulls compressed input from a ByteSource in
+ * INPUT_BLOCK pieces and is itself a ByteSource of the decompressed bytes.
+ * Concatenated streams (gzip members, zstd and lz4 frames) are decoded back
+ * to back.
+ */
+class Decoder : public ByteSource {
+  public:
+    static constexpr size_t INPUT_BLOCK = 256 * 1024;
+
+    explicit Decoder(ByteSource &input) : input(&input), in(INPUT_BLOCK) {}
+
+    size_t read(char *buf, size_t len) override {
+        size_t done = 0;
+        while (done < len) {
+            if (pos == end && !eof) {
+                end = input->read(in.data(), in.size());
+                pos = 0;
+                eof = end < in.size();
+            }
+            size_t consumed = end - pos, produced = len - done;
+            step(in.data() + pos, consumed, buf + done, produced);
+            pos += consumed;
+            done += produced;
+            if (consumed == 0 && produced == 0 && pos == end && eof) {
+                finish();
+                break;
+            }
+            if (consumed == 0 && produced == 0 && pos < end)
+                fail("decoder", "no progress on remaining input");
+        }
+        return done;
+    }
+
+    /* \brief decode another input with the same context */
+    void restart(ByteSource &next) {
+        input = &next;
+        pos = end = 0;
+        eof = false;
+        reset();
+    }
+
+  protected:
+    /* \brief decode from src into dst; the sizes are updated to the bytes
+     * consumed and produced */
+    virtual void step(const char *src, size_t &src_n, char *dst,
+                      size_t &dst_n) = 0;
+    virtual void reset() = 0;
+    /* \brief the input ended; fails inside a member or frame */
+    virtual void finish() = 0;
+
+    [[noreturn]] static void fail(const char *codec, const char *what) {
+        fprintf(stderr, "%s: %s\n", codec, what);
+        exit(1);
+    }
+
+  private:
+    ByteSource *input;
+    std::vector<char> in;
+    size_t pos = 0, end = 0;
+    bool eof = false;
+};
+
+#ifdef ONEBRC_HAVE_ZLIB
+class GzipDecoder : public Decoder {
+  public:
+    explicit GzipDecoder(ByteSource &input) : Decoder(input) {
+        memset(&z, 0, sizeof(z));
+        /* 15 window bits, +32: accept gzip and zlib headers */
+        if (inflateInit2(&z, 15 + 32) != Z_OK)
+            fail("gzip", "inflateInit2 failed");
+    }
+
+    ~GzipDecoder() override { inflateEnd(&z); }
+
+  protected:
+    void step(const char *src, size_t &src_n, char *dst,
+              size_t &dst_n) override {
+        z.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(src));
+        z.avail_in = uInt(src_n);
+        z.next_out = reinterpret_cast<Bytef *>(dst);
+        z.avail_out = uInt(dst_n);
+        const int ret = inflate(&z, Z_NO_FLUSH);
+        src_n -= z.avail_in;
+        dst_n -= z.avail_out;
+        if (ret == Z_STREAM_END) {
+            inflateReset(&z); /* another member may follow */
+            in_member = false;
+        } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            fail("gzip", z.msg ? z.msg : "corrupt input");
+        } else if (src_n > 0 || dst_n > 0) {
+            in_member = true;
+        }
+    }
+
+    void reset() override {
+        inflateReset(&z);
+        in_member = false;
+    }
+
+    void finish() override {
+        if (in_member)
+            fail("gzip", "truncated input");
+    }
+
+  private:
+    z_stream z;
+    bool in_member = false;
+};
+#endif
+
+#ifdef ONEBRC_HAVE_ZSTD
+class ZstdDecoder : public Decoder {
+  public:
+    explicit ZstdDecoder(ByteSource &input)
+        : Decoder(input), dctx(ZSTD_createDCtx()) {
+        if (!dctx)
+            fail("zstd", "ZSTD_createDCtx failed");
+    }
+
+    ~ZstdDecoder() override { ZSTD_freeDCtx(dctx); }
+
+  protected:
+    void step(const char *src, size_t &src_n, char *dst,
+              size_t &dst_n) override {
+        ZSTD_inBuffer in = {src, src_n, 0};
+        ZSTD_outBuffer out = {dst, dst_n, 0};
+        const size_t ret = ZSTD_decompressStream(dctx, &out, &in);
+        if (ZSTD_isError(ret))
+            fail("zstd", ZSTD_getErrorName(ret));
+        src_n = in.pos;
+        dst_n = out.pos;
+        /* 0 once a frame is decoded and flushed; a call without progress
+         * only hints at the size of the next frame header */
+        if (src_n > 0 || dst_n > 0)
+            in_frame = ret != 0;
+    }
+
+    void reset() override {
+        ZSTD_DCtx_reset(dctx, ZSTD_reset_session_only);
+        in_frame = false;
+    }
+
+    void finish() override {
+        if (in_frame)
+            fail("zstd", "truncated input");
+    }
+
+  private:
+    ZSTD_DCtx *dctx;
+    bool in_frame = false;
+};
+#endif
+
+#ifdef ONEBRC_HAVE_LZ4
+class Lz4Decoder : public Decoder {
+  public:
+    explicit Lz4Decoder(ByteSource &input) : Decoder(input) {
+        if (LZ4F_isError(LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION)))
+            fail("lz4", "LZ4F_createDecompressionContext failed");
+    }
+
+    ~Lz4Decoder() override { LZ4F_freeDecompressionContext(dctx); }
+
+  protected:
+    void step(const char *src, size_t &src_n, char *dst,
+              size_t &dst_n) override {
+        const size_t ret =
+            LZ4F_decompress(dctx, dst, &dst_n, src, &src_n, nullptr);
+        if (LZ4F_isError(ret))
+            fail("lz4", LZ4F_getErrorName(ret));
+        /* 0 once a frame is decoded and flushed, as for zstd */
+        if (src_n > 0 || dst_n > 0)
+            in_frame = ret != 0;
+    }
+
+    void reset() override {
+        LZ4F_resetDecompressionContext(dctx);
+        in_frame = false;
+    }
+
+    void finish() override {
+        if (in_frame)
+            fail("lz4", "truncated input");
+    }
+
+  private:
+    LZ4F_dctx *dctx = nullptr;
+    bool in_frame = false;
+};
+#endif
+
+/* \brief exits when the build has no support for compression */
+inline std::unique_ptr<Decoder>
+makeDecoder(Compression compression, [[maybe_unused]] ByteSource &input) {
+    switch (compression) {
+#ifdef ONEBRC_HAVE_ZLIB
+    case Compression::Gzip:
+        return std::make_unique<GzipDecoder>(input);
+#endif
+#ifdef ONEBRC_HAVE_ZSTD
+    case Compression::Zstd:
+        return std::make_unique<ZstdDecoder>(input);
+#endif
+#ifdef ONEBRC_HAVE_LZ4
+    case Compression::Lz4:
+        return std::make_unique<Lz4Decoder>(input);
+#endif
+    default:
+        fprintf(stderr, "%s input, but built without %s support\n",
+                compressionName(compression), compressionName(compression));
+        exit(1);
+    }
+}
+
+/*
+ * \brief can the frames of this input be located without decoding them, and
+ * decoded in parallel (see splitFrames)
+ */
+inline bool hasIndependentFrames([[maybe_unused]] Compression compression) {
+#ifdef ONEBRC_HAVE_ZSTD
+    if (compression == Compression::Zstd)
+        return true;
+#endif
+#ifdef ONEBRC_HAVE_LZ4
+    if (compression == Compression::Lz4)
+        return true;
+#endif
+    return false;
+}
+
+namespace detail {
+
+inline uint32_t loadLe32(const unsigned char *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/*
+ * \brief compressed size of the lz4 frame (or skippable frame) at p, 0 if
+ * malformed; walks the block headers of the frame format
+ */
+inline size_t lz4FrameSize(const char *data, size_t n) {
+    const auto *p = reinterpret_cast<const unsigned char *>(data);
+    if (n < 8)
+        return 0;
+    const uint32_t magic = loadLe32(p);
+    if ((magic & 0xFFFFFFF0) == 0x184D2A50) {
+        const size_t size = 8 + size_t(loadLe32(p + 4));
+        return size <= n ? size : 0;
+    }
+    if (magic != 0x184D2204)
+        return 0;
+
+    const unsigned char flg = p[4];
+    const bool block_checksum = flg & 0x10;
+    const bool content_size = flg & 0x08;
+    const bool content_checksum = flg & 0x04;
+    const bool dict_id = flg & 0x01;
+    size_t off = 4 + 2 + (content_size ? 8 : 0) + (dict_id ? 4 : 0) + 1;
+    while (true) {
+        if (off + 4 > n)
+            return 0;
+        /* only an all-zero word ends the frame: 0x80000000 is an empty
+         * uncompressed block */
+        const uint32_t header = loadLe32(p + off);
+        off += 4;
+        if (header == 0)
+            break;
+        off += (header & 0x7FFFFFFF) + (block_checksum ? 4 : 0);
+    }
+    off += content_checksum ? 4 : 0;
+    return off <= n ? off : 0;
+}
+
+} // namespace detail
+
+/*
+ * \brief [offset, size) of every frame of a zstd or lz4 file, each of which
+ * decodes independently of the others; exits on malformed input
+ */
+inline std::vector<std::pair<size_t, size_t>>
+splitFrames(Compression compression, const char *data, size_t size) {
+    std::vector<std::pair<size_t, size_t>> frames;
+    for (size_t off = 0; off < size;) {
+        size_t frame = 0;
+#ifdef ONEBRC_HAVE_ZSTD
+        if (compression == Compression::Zstd) {
+            frame = ZSTD_findFrameCompressedSize(data + off, size - off);
+            if (ZSTD_isError(frame))
+                frame = 0;
+        }
+#endif
+        if (compression == Compression::Lz4)
+            frame = detail::lz4FrameSize(data + off, size - off);
+        if (frame == 0) {
+            fprintf(stderr, "%s: malformed frame at offset %zu\n",
+                    compressionName(compression), off);
+            exit(1);
+        }
+        frames.emplace_back(off, frame);
+        off += frame;
+    }
+    return frames;
+}
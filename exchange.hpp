@@ -0,0 +1,243 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string.h>
+#include <utility>
+#include <vector>
+
+#include "data.hpp"
+#include "ring_queue.hpp"
+#include "station_table.hpp"
+
+/*
+ * High-cardinality mode: keys are radix-partitioned by hash bits and every
+ * partition is owned by exactly one worker, so each key lives in one table
+ * and memory grows with the number of distinct keys instead of keys x
+ * threads.
+ *
+ * Rows whose key belongs to another partition are appended to a per-worker
+ * outgoing Batch for that partition and handed over in bulk; owners drain
+ * their inbox between chunks. Batches are self-contained (the name bytes
+ * are copied), so they never point back into an input buffer.
+ *
+ * Workers start in the ordinary per-thread-table mode and process their
+ * first SAMPLE_SLICES_PER_WORKER slices of SAMPLE_SLICE bytes as a sample:
+ * a local table growing past HIGH_CARDINALITY_KEYS during the sample is the
+ * cardinality estimate that switches everybody over, after which each
+ * worker keeps the entries of its own partition and ships the rest. A
+ * sample that stays small freezes the ordinary mode.
+ */
+constexpr size_t HIGH_CARDINALITY_KEYS = 64 * 1024;
+constexpr size_t SAMPLE_SLICE = 1024 * 1024;
+constexpr uint32_t SAMPLE_SLICES_PER_WORKER = 4;
+
+enum class Cardinality { Auto, Low, High };
+
+/*
+ * \brief append-only buffer of rows for one partition
+ *
+ * Record layout: uint32 length (bit 31 set for an aggregate), the name
+ * bytes, then either an int16 value or a whole Data. PADDING zero bytes
+ * after the last record keep makeNameKey's 16-byte load in bounds. Storage
+ * is only allocated on the first record.
+ */
+class Batch {
+  public:
+    static constexpr size_t CAPACITY = 16 * 1024;
+    static constexpr size_t PADDING = 16;
+
+    bool full() const { return used >= CAPACITY; }
+    bool empty() const { return used == 0; }
+
+    void add(const char *name, size_t len, int16_t value) {
+        put(uint32_t(len), name, len, &value, sizeof(value));
+    }
+
+    void add(const char *name, size_t len, const Data &data) {
+        put(uint32_t(len) | AGGREGATE, name, len, &data, sizeof(data));
+    }
+
+    /* \brief fold every record into table */
+    void applyTo(StationTable &table) const {
+        const char *p = bytes.data();
+        const char *end = p + used;
+        while (p < end) {
+            uint32_t header;
+            memcpy(&header, p, sizeof(header));
+            const size_t len = header & ~AGGREGATE;
+            const char *name = p + sizeof(header);
+            Data &data = table.find(name, len, makeNameKey(name, len));
+            p = name + len;
+            if (header & AGGREGATE) {
+                Data rhs;
+                memcpy(&rhs, p, sizeof(rhs));
+                data += rhs;
+                p += sizeof(rhs);
+            } else {
+                int16_t value;
+                memcpy(&value, p, sizeof(value));
+                data += value;
+                p += sizeof(value);
+            }
+        }
+    }
+
+  private:
+    static constexpr uint32_t AGGREGATE = 0x80000000;
+
+    void put(uint32_t header, const char *name, size_t len, const void *tail,
+             size_t tail_size) {
+        const size_t size = sizeof(header) + len + tail_size;
+        if (bytes.empty())
+            bytes.reserve(CAPACITY + 256 + PADDING);
+        bytes.resize(used + size + PADDING);
+        char *p = bytes.data() + used;
+        memcpy(p, &header, sizeof(header));
+        memcpy(p + sizeof(header), name, len);
+        memcpy(p + sizeof(header) + len, tail, tail_size);
+        used += size;
+    }
+
+    std::vector<char> bytes;
+    size_t used = 0;
+};
+
+class Exchange {
+  public:
+    Exchange(uint32_t n_partitions, Cardinality cardinality)
+        : n_partitions(n_partitions), inboxes(n_partitions),
+          mode(cardinality == Cardinality::Auto   ? UNDECIDED
+               : cardinality == Cardinality::High ? HIGH
+                                                  : LOW) {}
+
+    Exchange(const Exchange &) = delete;
+    Exchange &operator=(const Exchange &) = delete;
+
+    uint32_t partitions() const { return n_partitions; }
+
+    /* \brief high hash bits, so partitioning is independent of the table
+     * slot index taken from the low bits */
+    uint32_t partitionOf(uint64_t hash) const {
+        return uint32_t(((hash >> 32) * n_partitions) >> 32);
+    }
+
+    bool undecided() const {
+        return mode.load(std::memory_order_relaxed) == UNDECIDED;
+    }
+    bool partitioned() const {
+        return mode.load(std::memory_order_relaxed) == HIGH;
+    }
+
+    /* \brief report a worker's local table size after one sample slice */
+    void observe(size_t local_keys) {
+        uint8_t expected = UNDECIDED;
+        if (local_keys > HIGH_CARDINALITY_KEYS)
+            mode.compare_exchange_strong(expected, HIGH);
+        else if (sampled.fetch_add(1, std::memory_order_relaxed) + 1 >=
+                 SAMPLE_SLICES_PER_WORKER * n_partitions)
+            mode.compare_exchange_strong(expected, LOW);
+    }
+
+    /* \brief a worker ran out of input; freezes an undecided mode */
+    void finish() {
+        uint8_t expected = UNDECIDED;
+        mode.compare_exchange_strong(expected, LOW);
+    }
+
+    void send(uint32_t partition, Batch &&batch) {
+        Inbox &inbox = inboxes[partition];
+        {
+            std::lock_guard lk(inbox.mtx);
+            inbox.batches.push_back(std::move(batch));
+        }
+        inbox.cv.notify_one();
+    }
+
+    /* \brief apply everything queued for partition to table */
+    void drain(uint32_t partition, StationTable &table) {
+        Inbox &inbox = inboxes[partition];
+        std::vector<Batch> batches;
+        {
+            std::lock_guard lk(inbox.mtx);
+            if (inbox.batches.empty())
+                return;
+            batches.swap(inbox.batches);
+        }
+        for (const Batch &batch : batches)
+            batch.applyTo(table);
+    }
+
+    /*
+     * \brief called once a worker has flushed all its outgoing batches;
+     * keeps draining partition into table until every worker has flushed
+     */
+    void arriveAndDrain(uint32_t partition, StationTable &table) {
+        if (flushed.fetch_add(1) + 1 == n_partitions)
+            for (Inbox &inbox : inboxes) {
+                std::lock_guard lk(inbox.mtx);
+                inbox.cv.notify_all();
+            }
+        Inbox &inbox = inboxes[partition];
+        while (true) {
+            drain(partition, table);
+            std::unique_lock lk(inbox.mtx);
+            if (flushed.load() == n_partitions && inbox.batches.empty())
+                return;
+            inbox.cv.wait_for(lk, std::chrono::milliseconds(1), [&] {
+                return !inbox.batches.empty() ||
+                       flushed.load() == n_partitions;
+            });
+        }
+    }
+
+  private:
+    static constexpr uint8_t UNDECIDED = 0, LOW = 1, HIGH = 2;
+
+    struct alignas(CACHE_LINE) Inbox {
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::vector<Batch> batches;
+    };
+
+    const uint32_t n_partitions;
+    std::vector<Inbox> inboxes;
+    alignas(CACHE_LINE) std::atomic<uint8_t> mode;
+    std::atomic<uint32_t> sampled{0};
+    std::atomic<uint32_t> flushed{0};
+};
+
+/* \brief one worker's outgoing batches, one per partition */
+class Outbox {
+  public:
+    Outbox(Exchange &exchange)
+        : exchange(exchange), batches(exchange.partitions()) {}
+
+    void add(uint32_t partition, const char *name, size_t len, int16_t value) {
+        Batch &batch = batches[partition];
+        batch.add(name, len, value);
+        if (batch.full())
+            exchange.send(partition, std::exchange(batch, Batch()));
+    }
+
+    void add(uint32_t partition, const char *name, size_t len,
+             const Data &data) {
+        Batch &batch = batches[partition];
+        batch.add(name, len, data);
+        if (batch.full())
+            exchange.send(partition, std::exchange(batch, Batch()));
+    }
+
+    void flush() {
+        for (uint32_t p = 0; p < batches.size(); ++p)
+            if (!batches[p].empty())
+                exchange.send(p, std::exchange(batches[p], Batch()));
+    }
+
+  private:
+    Exchange &exchange;
+    std::vector<Batch> batches;
+};
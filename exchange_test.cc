@@ -0,0 +1,64 @@
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "exchange.hpp"
+
+/*
+ * exchange_test: rows and aggregates shipped through an Outbox must reach
+ * the owner's table intact, including names far longer than any station.
+ */
+
+struct Row {
+    std::string name;
+    int16_t value;
+};
+
+int main() {
+    const std::vector<std::string> names = {
+        "A", "Bc", std::string(15, 'x'), std::string(16, 'y'),
+        std::string(40000, 'z'), std::string(70000, 'w')};
+
+    std::vector<Row> rows;
+    for (int i = 0; i < 5000; ++i)
+        rows.push_back({names[i % names.size()], int16_t(i % 1999 - 999)});
+
+    std::map<std::string, Data> expected;
+    for (const Row &row : rows)
+        expected[row.name] += row.value;
+
+    Exchange exchange(1, Cardinality::High);
+    Outbox outbox(exchange);
+    StationTable table;
+    for (size_t i = 0; i < rows.size(); ++i) {
+        const Row &row = rows[i];
+        if (i % 2) {
+            outbox.add(0, row.name.data(), row.name.size(), row.value);
+        } else {
+            /* the same row as a one-row aggregate */
+            Data data;
+            data += row.value;
+            outbox.add(0, row.name.data(), row.name.size(), data);
+        }
+    }
+    outbox.flush();
+    exchange.arriveAndDrain(0, table);
+
+    int failures = 0;
+    if (table.size() != expected.size()) {
+        std::cout << "FAIL: " << table.size() << " keys, expected "
+                  << expected.size() << "\n";
+        ++failures;
+    }
+    for (const auto &[name, data] : table) {
+        const auto it = expected.find(std::string(name));
+        if (it == expected.end() || it->second.sum != data.sum ||
+            it->second.occurences != data.occurences ||
+            it->second.min != data.min || it->second.max != data.max) {
+            std::cout << "FAIL: name of " << name.size() << " bytes\n";
+            ++failures;
+        }
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/inotify.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+
+/*
+ * inotify watch on one file, for following an append-only input. Appends
+ * show up as IN_MODIFY; a rotated or deleted file as IN_MOVE_SELF or
+ * IN_DELETE_SELF, after which the path is watched again once it exists.
+ */
+class FileWatcher {
+  public:
+    static constexpr uint32_t EVENTS = IN_MODIFY | IN_CLOSE_WRITE |
+                                       IN_ATTRIB | IN_MOVE_SELF |
+                                       IN_DELETE_SELF;
+
+    explicit FileWatcher(std::string path) : path(std::move(path)) {
+        fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+        if (fd == -1) {
+            perror("inotify_init1");
+            exit(1);
+        }
+        watch();
+    }
+
+    ~FileWatcher() { close(fd); }
+
+    FileWatcher(const FileWatcher &) = delete;
+    FileWatcher &operator=(const FileWatcher &) = delete;
+
+    /*
+     * \brief block until the file changes and drain the pending events;
+     * true if the file was replaced, in which case the new file at path is
+     * watched on return
+     */
+    bool wait() {
+        pollfd pfd = {fd, POLLIN, 0};
+        while (poll(&pfd, 1, -1) == -1) {
+            if (errno != EINTR) {
+                perror("poll");
+                exit(1);
+            }
+        }
+
+        bool replaced = false;
+        alignas(inotify_event) char buf[4096];
+        ssize_t n;
+        while ((n = read(fd, buf, sizeof(buf))) > 0) {
+            for (char *p = buf; p < buf + n;) {
+                const inotify_event *event =
+                    reinterpret_cast<const inotify_event *>(p);
+                replaced |= event->mask & (IN_MOVE_SELF | IN_DELETE_SELF |
+                                           IN_IGNORED);
+                p += sizeof(inotify_event) + event->len;
+            }
+        }
+        if (replaced) {
+            inotify_rm_watch(fd, wd);
+            watch();
+        }
+        return replaced;
+    }
+
+  private:
+    /* \brief poll for the path to exist again, as after a log rotation */
+    void watch() {
+        while ((wd = inotify_add_watch(fd, path.c_str(), EVENTS)) == -1) {
+            if (errno != ENOENT) {
+                perror(path.c_str());
+                exit(1);
+            }
+            std::this_thread::sleep_for(RETRY);
+        }
+    }
+
+    static constexpr std::chrono::milliseconds RETRY{100};
+
+    std::string path;
+    int fd;
+    int wd;
+};
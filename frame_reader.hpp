@@ -0,0 +1,182 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "chunk.hpp"
+#include "decompress.hpp"
+#include "mmap_file.hpp"
+#include "shared_queue.hpp"
+#include "stream_reader.hpp"
+
+/*
+ * Parallel decompression of zstd and lz4 files, whose frames decode
+ * independently: the mapped files are split into frames up front and
+ * n_decoders threads claim whole frames of any file, each decoding into
+ * pool buffers that are published as row-aligned Chunks, like
+ * StreamReader's.
+ *
+ * Frame boundaries fall anywhere inside rows. Decoding frame j withholds its
+ * head (everything up to and including its first '\n', unless j == 0) and
+ * its tail (everything after its last '\n'). Laid end to end in frame order
+ * these fragments are whole rows again, tail j - 1 + head j forming the row
+ * cut by boundary j, and a frame without any '\n' is all head, which lets
+ * the row run on into the next frame. The first frame of a file has no
+ * head, and a file whose last row is unterminated gets a '\n' so it does not
+ * run into the next file. The stitched rows are published as one last chunk
+ * once every frame is decoded.
+ */
+class FrameReader {
+  public:
+    FrameReader(const std::vector<std::string> &paths, MapPolicy policy,
+                size_t block, uint32_t n_decoders, uint32_t n_consumers)
+        : block((block + BufferPool::ALIGN - 1) / BufferPool::ALIGN *
+                BufferPool::ALIGN),
+          n_decoders(n_decoders),
+          pool(2 * n_decoders + n_consumers, this->block) {
+        for (const std::string &path : paths)
+            files.push_back(std::make_unique<MMapFile>(path.c_str(), policy));
+    }
+
+    FrameReader(const FrameReader &) = delete;
+    FrameReader &operator=(const FrameReader &) = delete;
+
+    std::optional<Chunk> pop() { return chunks.pop(); }
+
+    void release(const Chunk &chunk) {
+        if (pool.owns(chunk.data))
+            pool.release(chunk.data);
+    }
+
+    /* \brief decode every frame, publishing chunks; closes the queue */
+    void run() {
+        for (uint32_t f = 0; f < files.size(); ++f) {
+            const MMapFile &file = *files[f];
+            const Compression compression = detectCompression(
+                std::string_view(file.begin(), file.size()));
+            bool first = true;
+            for (const auto &[offset, size] :
+                 splitFrames(compression, file.begin(), file.size())) {
+                frames.push_back(
+                    {file.begin() + offset, size, compression, f, first});
+                first = false;
+            }
+        }
+        fragments.resize(frames.size());
+
+        std::vector<std::thread> decoders;
+        for (uint32_t i = 0; i < n_decoders; ++i)
+            decoders.emplace_back([this] { decodeFrames(); });
+        for (std::thread &decoder : decoders)
+            decoder.join();
+
+        for (size_t j = 0; j < frames.size(); ++j) {
+            if (frames[j].first && !stitched.empty() &&
+                stitched.back() != '\n')
+                stitched += '\n';
+            stitched += fragments[j].head + fragments[j].tail;
+        }
+        const size_t size = stitched.size();
+        stitched.append(CHUNK_PADDING, '\0');
+        if (size > 0)
+            chunks.push({stitched.data(), size});
+        chunks.close();
+    }
+
+  private:
+    struct Frame {
+        const char *data;
+        size_t size;
+        Compression compression;
+        uint32_t file;
+        /* first frame of its file */
+        bool first;
+    };
+
+    struct Fragments {
+        std::string head, tail;
+    };
+
+    void decodeFrames() {
+        /* one decoder per format, reused across frames */
+        std::unique_ptr<Decoder> decoders[size_t(Compression::Lz4) + 1];
+        for (size_t j; (j = next_frame.fetch_add(1)) < frames.size();) {
+            MemorySource frame(frames[j].data, frames[j].size);
+            std::unique_ptr<Decoder> &decoder =
+                decoders[size_t(frames[j].compression)];
+            if (decoder)
+                decoder->restart(frame);
+            else
+                decoder = makeDecoder(frames[j].compression, frame);
+            decodeFrame(j, *decoder);
+        }
+    }
+
+    void decodeFrame(size_t j, ByteSource &frame) {
+        Fragments &fragment = fragments[j];
+        bool in_head = !frames[j].first;
+        std::string carry;
+        while (true) {
+            char *data = pool.acquire();
+            const size_t n = frame.read(data, block);
+            const bool last = n < block;
+            char *begin = data - carry.size();
+            memcpy(begin, carry.data(), carry.size());
+            char *end = data + n;
+
+            if (in_head) {
+                char *first =
+                    static_cast<char *>(memchr(begin, '\n', end - begin));
+                char *head_end = first ? first + 1 : end;
+                fragment.head.append(begin, head_end);
+                begin = head_end;
+                in_head = !first;
+            }
+
+            const void *nl = memrchr(begin, '\n', end - begin);
+            char *cut =
+                nl ? static_cast<char *>(const_cast<void *>(nl)) + 1 : begin;
+            if (last) {
+                fragment.tail.assign(cut, end);
+                publish(data, begin, cut);
+                return;
+            }
+            if (size_t(end - cut) > BufferPool::HEADROOM) {
+                fprintf(stderr, "row longer than %zu bytes\n",
+                        BufferPool::HEADROOM);
+                exit(1);
+            }
+            carry.assign(cut, end);
+            publish(data, begin, cut);
+        }
+    }
+
+    void publish(char *buffer, char *begin, char *end) {
+        if (begin == end)
+            pool.release(buffer);
+        else
+            chunks.push({begin, size_t(end - begin)});
+    }
+
+    const size_t block;
+    const uint32_t n_decoders;
+    BufferPool pool;
+    std::vector<std::unique_ptr<MMapFile>> files;
+    std::vector<Frame> frames;
+    std::vector<Fragments> fragments;
+    std::atomic<size_t> next_frame{0};
+    std::string stitched;
+    /* several decoders publish, so not the single-producer RingQueue */
+    SharedQueue<Chunk> chunks;
+};
@@ -0,0 +1,169 @@
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <fcntl.h>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "generator.hpp"
+#include "output.hpp"
+#include "parse_size.hpp"
+#include "timer.hpp"
+
+/*
+ * gen: write synthetic measurements (see generator.hpp). Every thread
+ * generates whole blocks into its own buffer and writes them out in block
+ * order, so at most n_threads blocks are in flight.
+ */
+
+struct GenOptions {
+    GeneratorOptions generator;
+    uint32_t n_threads = std::thread::hardware_concurrency();
+    std::string output;
+};
+
+void printGenUsage(const char *prog) {
+    std::cerr << "Usage " << prog
+              << " [--rows N[K|M|G]] [--seed N] [--threads N]"
+                 " [--stations N[K|M]] [--name-length MIN:MAX]"
+                 " [--zipf EXPONENT] [--crlf] [--utf8] <output_file|->\n";
+}
+
+/* \brief "<min>:<max>" name lengths within 1..Generator::MAX_NAME */
+std::optional<std::pair<uint32_t, uint32_t>>
+parseNameLength(std::string_view value) {
+    const size_t colon = value.find(':');
+    if (colon == value.npos)
+        return std::nullopt;
+    const size_t min = parseCount(value.substr(0, colon));
+    const size_t max = parseCount(value.substr(colon + 1));
+    if (min == 0 || min > max || max > Generator::MAX_NAME)
+        return std::nullopt;
+    return std::pair<uint32_t, uint32_t>(min, max);
+}
+
+/* \brief a non-negative decimal number */
+std::optional<double> parseExponent(std::string_view value) {
+    const std::string s(value);
+    char *end = nullptr;
+    const double x = std::strtod(s.c_str(), &end);
+    if (s.empty() || *end != '\0' || !(x >= 0))
+        return std::nullopt;
+    return x;
+}
+
+bool parseGenOptions(int argc, char **argv, GenOptions &opts) {
+    std::vector<std::string_view> positional;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg.size() < 2 || arg.substr(0, 2) != "--") {
+            positional.push_back(arg);
+            continue;
+        }
+
+        std::string_view name = arg.substr(2), value;
+        if (name == "crlf") {
+            opts.generator.crlf = true;
+            continue;
+        }
+        if (name == "utf8") {
+            opts.generator.utf8 = true;
+            continue;
+        }
+        if (const size_t eq = name.find('='); eq != name.npos) {
+            value = name.substr(eq + 1);
+            name = name.substr(0, eq);
+        } else if (i + 1 < argc) {
+            value = argv[++i];
+        }
+
+        if (name == "rows" && parseCount(value) > 0) {
+            opts.generator.rows = parseCount(value);
+        } else if (name == "seed" && (value == "0" || parseCount(value) > 0)) {
+            opts.generator.seed = parseCount(value);
+        } else if (name == "threads" && parseCount(value) > 0) {
+            opts.n_threads = parseCount(value);
+        } else if (name == "stations" && parseCount(value) > 0 &&
+                   parseCount(value) <= UINT32_MAX) {
+            opts.generator.stations = parseCount(value);
+        } else if (name == "name-length" && parseNameLength(value)) {
+            std::tie(opts.generator.min_name, opts.generator.max_name) =
+                *parseNameLength(value);
+        } else if (name == "zipf" && parseExponent(value)) {
+            opts.generator.zipf = *parseExponent(value);
+        } else {
+            std::cerr << "Unknown option: " << arg << "\n";
+            printGenUsage(argv[0]);
+            return false;
+        }
+    }
+
+    if (positional.size() != 1) {
+        printGenUsage(argv[0]);
+        return false;
+    }
+    opts.output = positional[0];
+    return true;
+}
+
+int main(int argc, char **argv) {
+    Timer timer;
+
+    GenOptions opts;
+    if (!parseGenOptions(argc, argv, opts))
+        return 1;
+
+    const int fd = opts.output == "-"
+                       ? STDOUT_FILENO
+                       : open(opts.output.c_str(),
+                              O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        perror(opts.output.c_str());
+        return 1;
+    }
+
+    const Generator generator(opts.generator);
+    std::atomic<uint64_t> next_block{0}, next_write{0};
+    std::atomic<bool> failed{false};
+    std::atomic<uint64_t> bytes{0};
+    const auto generate = [&] {
+        std::unique_ptr<char[]> buf(
+            new char[Generator::BLOCK_ROWS * Generator::MAX_ROW]);
+        for (uint64_t b; (b = next_block.fetch_add(1)) < generator.blocks();) {
+            const size_t n = generator.fill(b, buf.get());
+            for (uint64_t w; (w = next_write.load()) != b;)
+                next_write.wait(w);
+            if (!failed && !writeAll(fd, std::string_view(buf.get(), n)))
+                failed = true;
+            bytes += n;
+            next_write.store(b + 1);
+            next_write.notify_all();
+        }
+    };
+
+    std::vector<std::future<void>> workers;
+    for (uint32_t i = 0; i < opts.n_threads; ++i)
+        workers.push_back(std::async(std::launch::async, generate));
+    for (auto &worker : workers)
+        worker.get();
+    if (fd != STDOUT_FILENO && close(fd) == -1) {
+        perror(opts.output.c_str());
+        return 1;
+    }
+    if (failed)
+        return 1;
+
+    std::cerr << "Wrote " << opts.generator.rows << " rows of "
+              << generator.stations() << " stations, " << bytes
+              << " bytes in " << timer.elapsedMs() << "ms\n";
+    return 0;
+}
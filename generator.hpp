@@ -0,0 +1,242 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "weather_stations.hpp"
+
+/*
+ * Synthetic measurements in the distribution of the original challenge:
+ * stations drawn from WEATHER_STATIONS (or synthesized past its 413
+ * entries), temperatures normal around each station's mean with a standard
+ * deviation of 10 degrees, clamped to -99.9..99.9.
+ *
+ * Output is cut into blocks of BLOCK_ROWS rows, each generated from its own
+ * random stream seeded by (seed, block index), so the bytes of a file only
+ * depend on the options and not on how many threads produced it.
+ */
+struct GeneratorOptions {
+    uint64_t rows = 1'000'000'000;
+    uint64_t seed = 0;
+    /* key cardinality */
+    uint32_t stations = std::size(WEATHER_STATIONS);
+    /* byte lengths of synthesized names; 0 keeps the standard names */
+    uint32_t min_name = 0, max_name = 0;
+    /* Zipf exponent of station popularity by rank, 0 for uniform */
+    double zipf = 0;
+    /* "\r\n" row endings */
+    bool crlf = false;
+    /* synthesized names of 1 to 4 byte UTF-8 characters */
+    bool utf8 = false;
+};
+
+namespace detail {
+
+/* \brief splitmix64: tiny state, passes BigCrush, fast enough per row */
+struct Rng {
+    uint64_t state;
+
+    uint64_t next() {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+};
+
+/* name characters: never ';' or '\n', UTF-8 ones of every length */
+inline constexpr std::string_view ASCII_CHARS =
+    "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ ";
+inline constexpr std::string_view UTF8_CHARS[] = {
+    "a", "e", "o", "n", "r", "é", "ü", "ø",
+    "ł", "ș", "中", "€", "ก", "𝄞", "😀"};
+
+} // namespace detail
+
+class Generator {
+  public:
+    /* the longest name allowed by the challenge rules, in bytes */
+    static constexpr size_t MAX_NAME = 100;
+    /* name, ';', "-99.9", "\r\n" */
+    static constexpr size_t MAX_ROW = MAX_NAME + 8;
+    static constexpr uint64_t BLOCK_ROWS = 64 * 1024;
+    static constexpr double STDDEV = 10.0;
+    /* quantiles of the standard normal distribution, one per 16-bit draw */
+    static constexpr size_t NORMAL_TABLE = 1 << 16;
+    /* bytes copied for any name that fits, fewer than MAX_ROW */
+    static constexpr size_t COPY = 32;
+
+    explicit Generator(const GeneratorOptions &opts) : opts(opts) {
+        makeStations();
+        for (const std::string &name : names) {
+            key_offsets.push_back(keys.size());
+            keys += name;
+            keys += ';';
+        }
+        key_offsets.push_back(keys.size());
+        keys.append(COPY, '\0');
+        makeAliasTable();
+        makeNormalTable();
+    }
+
+    uint64_t blocks() const {
+        return (opts.rows + BLOCK_ROWS - 1) / BLOCK_ROWS;
+    }
+
+    size_t stations() const { return names.size(); }
+    std::string_view station(size_t i) const { return names[i]; }
+
+    /*
+     * \brief write the rows of block b to out, which has room for
+     * BLOCK_ROWS * MAX_ROW bytes; returns the number of bytes written
+     */
+    size_t fill(uint64_t b, char *out) const {
+        detail::Rng rng{opts.seed * 0xD1B54A32D192ED03ull + b};
+        const uint64_t rows =
+            std::min(BLOCK_ROWS, opts.rows - b * BLOCK_ROWS);
+        char *p = out;
+        for (uint64_t r = 0; r < rows; ++r) {
+            const uint64_t draw = rng.next();
+            const uint32_t column =
+                uint32_t(((draw >> 32) * uint64_t(names.size())) >> 32);
+            const uint32_t id =
+                uint32_t(draw) < threshold[column] ? column : alias[column];
+            const int tenths =
+                std::clamp(means[id] + normal[rng.next() >> 48], -999, 999);
+
+            /* rows never outgrow MAX_ROW, so a short name may copy COPY */
+            const char *name = keys.data() + key_offsets[id];
+            const size_t len = key_offsets[id + 1] - key_offsets[id];
+            memcpy(p, name, len <= COPY ? COPY : len);
+            p += len;
+            p = formatTenths(p, tenths);
+            if (opts.crlf)
+                *p++ = '\r';
+            *p++ = '\n';
+        }
+        return p - out;
+    }
+
+  private:
+    static char *formatTenths(char *p, int tenths) {
+        if (tenths < 0) {
+            *p++ = '-';
+            tenths = -tenths;
+        }
+        if (tenths >= 100)
+            *p++ = char('0' + tenths / 100);
+        *p++ = char('0' + tenths / 10 % 10);
+        *p++ = '.';
+        *p++ = char('0' + tenths % 10);
+        return p;
+    }
+
+    void makeStations() {
+        const bool synthesize = opts.utf8 || opts.max_name > 0;
+        uint32_t min_len = opts.min_name, max_len = opts.max_name;
+        if (max_len == 0) {
+            min_len = 4;
+            max_len = 24;
+        }
+        /* a unique suffix of base-52 letters keeps synthesized names apart */
+        size_t suffix = 1;
+        for (uint64_t n = 52; n < opts.stations; n *= 52)
+            ++suffix;
+
+        for (uint32_t i = 0; i < opts.stations; ++i) {
+            const WeatherStation &standard =
+                WEATHER_STATIONS[i % std::size(WEATHER_STATIONS)];
+            means.push_back(int(std::lround(standard.mean * 10)));
+            if (!synthesize && i < std::size(WEATHER_STATIONS)) {
+                names.emplace_back(standard.name);
+                continue;
+            }
+
+            detail::Rng rng{opts.seed ^ (uint64_t(i) << 32 | 0x5EED)};
+            const size_t len = std::clamp<size_t>(
+                min_len + rng.next() % (max_len - min_len + 1), suffix + 1,
+                MAX_NAME);
+            std::string name;
+            while (name.size() < len - suffix) {
+                const std::string_view c =
+                    opts.utf8
+                        ? detail::UTF8_CHARS[rng.next() %
+                                             std::size(detail::UTF8_CHARS)]
+                        : detail::ASCII_CHARS.substr(
+                              rng.next() % detail::ASCII_CHARS.size(), 1);
+                /* a character that does not fit makes room for ASCII */
+                if (name.size() + c.size() > len - suffix)
+                    name += 'x';
+                else
+                    name += c;
+            }
+            for (uint64_t n = i, k = 0; k < suffix; ++k, n /= 52)
+                name += detail::ASCII_CHARS[n % 52];
+            names.push_back(std::move(name));
+        }
+    }
+
+    /* \brief Vose's alias method: one draw picks a column and a side */
+    void makeAliasTable() {
+        const size_t n = names.size();
+        std::vector<double> scaled(n);
+        double total = 0;
+        for (size_t i = 0; i < n; ++i)
+            total += scaled[i] = std::pow(double(i + 1), -opts.zipf);
+        std::vector<uint32_t> small, large;
+        for (size_t i = 0; i < n; ++i) {
+            scaled[i] *= n / total;
+            (scaled[i] < 1 ? small : large).push_back(i);
+        }
+
+        threshold.assign(n, UINT32_MAX);
+        alias.resize(n);
+        for (size_t i = 0; i < n; ++i)
+            alias[i] = i;
+        while (!small.empty() && !large.empty()) {
+            const uint32_t s = small.back(), l = large.back();
+            small.pop_back();
+            threshold[s] = uint32_t(scaled[s] * 4294967296.0);
+            alias[s] = l;
+            scaled[l] -= 1 - scaled[s];
+            if (scaled[l] < 1) {
+                large.pop_back();
+                small.push_back(l);
+            }
+        }
+    }
+
+    /*
+     * \brief the inverse normal CDF at the midpoints of NORMAL_TABLE slices,
+     * scaled to STDDEV and rounded to tenths: entry k is the first v whose
+     * rounding interval reaches past probability (k + 0.5) / NORMAL_TABLE
+     */
+    void makeNormalTable() {
+        normal.resize(NORMAL_TABLE);
+        const double scale = STDDEV * 10 * std::sqrt(2.0);
+        int v = -999;
+        for (size_t k = 0; k < NORMAL_TABLE; ++k) {
+            const double p = (k + 0.5) / NORMAL_TABLE;
+            while (v < 999 && 0.5 * std::erfc(-(v + 0.5) / scale) < p)
+                ++v;
+            normal[k] = v;
+        }
+    }
+
+    GeneratorOptions opts;
+    std::vector<std::string> names;
+    /* every name followed by ';', back to back, then COPY bytes of slack */
+    std::string keys;
+    std::vector<uint32_t> key_offsets;
+    /* in tenths */
+    std::vector<int> means;
+    std::vector<uint32_t> threshold, alias;
+    std::vector<int> normal;
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+#include <fcntl.h>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "chunk.hpp"
+#include "io_util.hpp"
+#include "mmap_file.hpp"
+#include "trace.hpp"
+
+/*
+ * The uncompressed regular files of a run as one list of buffers for a
+ * chunk schedule or queue. Files of at least SMALL_FILE bytes are mapped
+ * with the requested policy. Smaller ones are read into a single shared
+ * batch buffer, so hundreds of small shards cost neither a mapping nor a
+ * handful of tiny chunks each. Within the batch every file is terminated
+ * with a '\n' if it does not end in one, so rows never run from one file
+ * into the next.
+ */
+class InputSet {
+  public:
+    static constexpr size_t SMALL_FILE = 1024 * 1024;
+
+    InputSet(const std::vector<std::string> &paths, MapPolicy policy) {
+        TRACE_SCOPE("map");
+        std::vector<std::pair<const char *, size_t>> small;
+        for (const std::string &path : paths) {
+            struct stat st;
+            if (stat(path.c_str(), &st) == -1) {
+                perror(path.c_str());
+                exit(1);
+            }
+            if (size_t(st.st_size) < SMALL_FILE)
+                small.emplace_back(path.c_str(), st.st_size);
+            else
+                files.push_back(
+                    std::make_unique<MMapFile>(path.c_str(), policy));
+        }
+        readBatch(small);
+
+        for (const std::unique_ptr<MMapFile> &file : files)
+            ranges.push_back({file->begin(), file->size()});
+        if (batch_size > 0)
+            ranges.push_back({batch.get(), batch_size});
+    }
+
+    InputSet(const InputSet &) = delete;
+    InputSet &operator=(const InputSet &) = delete;
+
+    const std::vector<Chunk> &buffers() const { return ranges; }
+
+    /* \brief the mapping when the run has exactly one input and it is
+     * mapped, else nullptr */
+    const MMapFile *single() const {
+        return files.size() == 1 && batch_size == 0 ? files[0].get()
+                                                    : nullptr;
+    }
+
+  private:
+    void readBatch(const std::vector<std::pair<const char *, size_t>> &small) {
+        size_t capacity = 0;
+        for (const auto &[path, size] : small)
+            capacity += size + 1;
+        if (capacity == 0)
+            return;
+        batch.reset(new char[capacity + CHUNK_PADDING]());
+
+        for (const auto &[path, size] : small) {
+            const int fd = open(path, O_RDONLY);
+            if (fd == -1) {
+                perror(path);
+                exit(1);
+            }
+            /* a file that grew since stat() is cut at its old size */
+            const size_t n = preadFull(fd, batch.get() + batch_size, size, 0);
+            close(fd);
+            batch_size += n;
+            if (n > 0 && batch[batch_size - 1] != '\n')
+                batch[batch_size++] = '\n';
+        }
+    }
+
+    std::vector<std::unique_ptr<MMapFile>> files;
+    std::unique_ptr<char[]> batch;
+    size_t batch_size = 0;
+    std::vector<Chunk> ranges;
+};
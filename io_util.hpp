@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* \brief pread until len bytes or end of file; exits on I/O errors */
+inline size_t preadFull(int fd, char *buf, size_t len, uint64_t offset) {
+    size_t done = 0;
+    while (done < len) {
+        const ssize_t n = pread(fd, buf + done, len - done, offset + done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0) {
+            perror("pread");
+            exit(1);
+        }
+        if (n == 0)
+            break;
+        done += n;
+    }
+    return done;
+}
@@ -1,148 +1,807 @@
+#include <algorithm>
+#include <atomic>
+#include <fcntl.h>
 #include <future>
 #include <iostream>
+#include <memory>
+#include <optional>
+#include <span>
 #include <string.h>
 #include <string>
+#include <sys/stat.h>
 #include <utility>
 #include <vector>
 
+#include "checkpoint.hpp"
 #include "chunk.hpp"
+#include "chunk_index.hpp"
+#include "chunk_schedule.hpp"
+#include "columnar.hpp"
 #include "data.hpp"
+#include "decompress.hpp"
+#include "exchange.hpp"
+#include "file_watcher.hpp"
+#include "frame_reader.hpp"
+#include "input_set.hpp"
 #include "mmap_file.hpp"
+#include "options.hpp"
+#include "output.hpp"
+#include "partial_file.hpp"
+#include "perf_counters.hpp"
+#include "prefetcher.hpp"
+#include "radix_sort.hpp"
+#include "result_cache.hpp"
+#include "result_merger.hpp"
+#include "ring_queue.hpp"
+#include "scanner.hpp"
 #include "shared_queue.hpp"
+#include "station_table.hpp"
+#include "stream_reader.hpp"
+#include "temperature.hpp"
 #include "timer.hpp"
-#include "unordered_dense.hpp"
+#include "trace.hpp"
 
-using Result = std::vector<std::pair<std::string_view, Data>>;
-using PartialResult = ankerl::unordered_dense::map<std::string_view, Data>;
-
-constexpr Chunk sentinel = {nullptr, 0};
-constexpr uint32_t CHUNK_SIZE = 128 * 1024;
-constexpr uint32_t MAX_LINE_LENGTH = 106;
 constexpr uint32_t EXPECTED_UNIQUE_STATIONS = 413;
+constexpr size_t CONVERT_CHUNK = 4 * 1024 * 1024;
+
+/* \brief feed the rows of [begin, end) to onRow; end is a row start */
+template <typename F>
+void processRows(ScanIsa isa, const char *begin, const char *end, F &&onRow) {
+    const char *tail = scanRows(isa, begin, end, onRow);
+
+    /* only the last chunk of the input can end in an unterminated row */
+    if (tail < end) {
+        const char *sc_ptr =
+            static_cast<const char *>(memchr(tail, ';', end - tail));
+        if (sc_ptr)
+            onRow(tail, sc_ptr - tail, sc_ptr + 1);
+    }
+}
 
-void combinePartialResult(PartialResult &lhs, const PartialResult &rhs) {
-    for (const auto &[k, v] : rhs)
-        lhs[k] += v;
+/* \brief source.pop(), traced as the time a worker waits for work */
+template <typename Source> std::optional<Chunk> popChunk(Source &source) {
+    TRACE_SCOPE("wait");
+    return source.pop();
 }
 
 /*
- * \brief fast parse for 3..5-char strings with exactly one decimal
- * (range 99.9..99.9)
+ * \brief aggregate every chunk handed out by source; Source is one of the
+ * queues, a ChunkSchedule or a StreamReader, anything whose pop() returns
+ * std::optional<Chunk>. Sources that recycle buffers get each chunk back
+ * through release(), an IndexBuilder the stations of each through record().
+ *
+ * A prefetcher, if any, is told where this worker is.
+ *
+ * Worker id owns partition id of the exchange. The finished table goes to
+ * merger: merged with the other workers' tables, or in high-cardinality mode
+ * kept as the disjoint partition id.
  */
-float parseTemperature(const char *s) {
-    const char *p = s;
-    int sign = 1;
-    if (*p == '-') {
-        sign = -1;
-        ++p;
-    }
-    /* pre = either 1-digit (p[1]=='.') or 2-digit; frac at p[2] or p[3] */
-    int pre = (p[1] == '.') ? (p[0] - '0') : ((p[0] - '0') * 10 + (p[1] - '0'));
-    int frac = p[(p[1] == '.') ? 2 : 3] - '0';
-    int combined = pre * 10 + frac; /* integer representation scaled by 10 */
-    return sign * (combined * 0.1f);
-}
-
-Result getOrderedResult(const PartialResult &result) {
-    Result res;
-    for (const auto &[k, v] : result)
-        res.emplace_back(k, v);
-    std::sort(res.begin(), res.end(), [](const auto &a, const auto &b) {
-        return memcmp(a.first.data(), b.first.data(),
-                      std::min(a.first.size(), b.first.size())) < 0;
-    });
-    return res;
-}
-
-PartialResult consumerThread(SharedQueue<Chunk> &queue) {
-    PartialResult res;
-    res.reserve(2 * EXPECTED_UNIQUE_STATIONS);
-    res.max_load_factor(0.7);
-    while (true) {
-        const Chunk chunk = queue.pop();
-        if (chunk == sentinel)
-            break;
-
-        const char *itr =
-            static_cast<const char *>(memchr(chunk.data, '\n', chunk.size));
-        if (!itr)
-            continue;
-        ++itr;
-        const char *end = chunk.data + chunk.size;
-        while (itr < end) {
-            const char *sc_ptr =
-                static_cast<const char *>(memchr(itr, ';', end - itr));
-            if (!sc_ptr)
-                break;
-            std::string_view name(itr, sc_ptr - itr);
-            res[std::move(name)] += parseTemperature(sc_ptr + 1);
-
-            itr = static_cast<const char *>(
-                memchr(sc_ptr + 1, '\n', end - (sc_ptr + 1)));
-            if (!itr)
-                break;
-            ++itr;
+template <typename Source>
+void consumerThread(Source &source, ScanIsa isa, Exchange &exchange,
+                    ResultMerger &merger, Prefetcher *prefetcher,
+                    uint32_t id) {
+    StageScope parse(Stage::Parse);
+    PartialResult res(EXPECTED_UNIQUE_STATIONS);
+    Outbox outbox(exchange);
+    bool partitioned = false;
+
+    const auto local = [&res](const char *name, size_t len,
+                              const char *value) {
+        TRACE_COUNT(Rows, 1);
+        res.find(name, len, makeNameKey(name, len)) += parseTemperature(value);
+    };
+    const auto routed = [&](const char *name, size_t len, const char *value) {
+        TRACE_COUNT(Rows, 1);
+        const NameKey key = makeNameKey(name, len);
+        const uint32_t owner = exchange.partitionOf(key.hash);
+        if (owner == id)
+            res.find(name, len, key) += parseTemperature(value);
+        else
+            outbox.add(owner, name, len, parseTemperature(value));
+    };
+    /* add this worker's partition of table to own, ship the rest */
+    const auto route = [&](const PartialResult &table, PartialResult &own) {
+        for (const auto &[name, data] : table) {
+            const NameKey key = makeNameKeyUnpadded(name);
+            const uint32_t owner = exchange.partitionOf(key.hash);
+            if (owner == id)
+                own.find(name.data(), name.size(), key) += data;
+            else
+                outbox.add(owner, name.data(), name.size(), data);
         }
+    };
+    /* keep this worker's partition of res and ship the rest to the owners */
+    const auto repartition = [&] {
+        PartialResult own(res.size() / exchange.partitions());
+        route(res, own);
+        res = std::move(own);
+        partitioned = true;
+    };
 
-        if (itr) {
-            const char *sc_ptr =
-                static_cast<const char *>(memchr(itr, ';', MAX_LINE_LENGTH));
-            if (sc_ptr) {
-                std::string_view name(itr, sc_ptr - itr);
-                res[std::move(name)] += parseTemperature(sc_ptr + 1);
+    while (const std::optional<Chunk> next = popChunk(source)) {
+        TRACE_SCOPE("chunk");
+        TRACE_COUNT(Chunks, 1);
+        if (prefetcher)
+            prefetcher->advance(id, next->data);
+        const char *itr = next->data;
+        const char *end = next->data + next->size;
+        if constexpr (requires { source.record(*next, res); }) {
+            /* the source indexes the stations of every chunk: aggregate the
+             * chunk on its own, then fold it in as the mode requires */
+            PartialResult stations(EXPECTED_UNIQUE_STATIONS);
+            processRows(isa, itr, end,
+                        [&stations](const char *name, size_t len,
+                                    const char *value) {
+                            TRACE_COUNT(Rows, 1);
+                            stations.find(name, len, makeNameKey(name, len)) +=
+                                parseTemperature(value);
+                        });
+            source.record(*next, stations);
+            if (!partitioned && exchange.partitioned())
+                repartition();
+            if (partitioned) {
+                route(stations, res);
+                exchange.drain(id, res);
+            } else {
+                combinePartialResult(res, stations);
+                if (exchange.undecided())
+                    exchange.observe(res.size());
             }
+        } else {
+            /* sampling and routing go slice by slice, the ordinary mode
+             * doesn't */
+            while (itr < end) {
+                if (!partitioned && exchange.partitioned())
+                    repartition();
+                const bool sampling = !partitioned && exchange.undecided();
+                const char *slice_end =
+                    partitioned || sampling
+                        ? nextRowStart(itr + SAMPLE_SLICE, next->data, end)
+                        : end;
+                if (partitioned) {
+                    processRows(isa, itr, slice_end, routed);
+                    exchange.drain(id, res);
+                } else {
+                    processRows(isa, itr, slice_end, local);
+                    if (sampling)
+                        exchange.observe(res.size());
+                }
+                itr = slice_end;
+            }
+        }
+        if constexpr (requires { source.release(*next); })
+            source.release(*next);
+    }
+
+    TRACE_FAULTS();
+    parse.stop();
+    const StageScope merge(Stage::Merge);
+    if (prefetcher)
+        prefetcher->retire(id);
+    exchange.finish();
+    if (!exchange.partitioned()) {
+        merger.merge(std::move(res));
+        return;
+    }
+    if (!partitioned)
+        repartition();
+    outbox.flush();
+    exchange.arriveAndDrain(id, res);
+    merger.keep(std::move(res));
+}
+
+/*
+ * \brief cut the buffers into ~chunk_size chunks on this thread and
+ * aggregate them on n_consumers threads through Queue
+ */
+template <typename Queue>
+std::vector<PartialResult> runQueued(const std::vector<Chunk> &buffers,
+                                     uint32_t n_consumers, size_t chunk_size,
+                                     ScanIsa isa,
+                                     Cardinality cardinality,
+                                     Prefetcher *prefetcher) {
+    Queue queue;
+    Exchange exchange(n_consumers, cardinality);
+    ResultMerger merger;
+
+    // Consumers
+    std::vector<std::future<void>> consumers;
+    for (uint32_t i = 0; i < n_consumers; ++i) {
+        consumers.push_back(std::async(
+            std::launch::async, consumerThread<Queue>, std::ref(queue), isa,
+            std::ref(exchange), std::ref(merger), prefetcher, i));
+    }
+
+    // Producer: chunks are cut on row starts, see nextRowStart
+    TRACE_SCOPE("produce");
+    for (const Chunk &buffer : buffers) {
+        const char *begin = buffer.data;
+        const char *end = buffer.data + buffer.size;
+        for (const char *itr = begin; itr < end;) {
+            const char *next = nextRowStart(itr + chunk_size, begin, end);
+            queue.push({itr, size_t(next - itr)});
+            itr = next;
         }
     }
-    return res;
+    queue.close();
+
+    // Wait consumers, they merge their results themselves
+    for (auto &consumer : consumers)
+        consumer.get();
+    return merger.take();
+}
+
+/*
+ * \brief n_workers threads claim the chunks of schedule directly; Schedule
+ * is a ChunkSchedule or an IndexBuilder
+ */
+template <typename Schedule>
+std::vector<PartialResult> runSchedule(Schedule &schedule, uint32_t n_workers,
+                                       ScanIsa isa, Cardinality cardinality,
+                                       Prefetcher *prefetcher) {
+    Exchange exchange(n_workers, cardinality);
+    ResultMerger merger;
+
+    std::vector<std::future<void>> workers;
+    for (uint32_t i = 0; i < n_workers; ++i) {
+        workers.push_back(std::async(
+            std::launch::async, consumerThread<Schedule>, std::ref(schedule),
+            isa, std::ref(exchange), std::ref(merger), prefetcher, i));
+    }
+
+    for (auto &worker : workers)
+        worker.get();
+    return merger.take();
+}
+
+/*
+ * \brief no producer thread: n_workers threads claim chunks of a guided
+ * schedule, of at least chunk_size bytes, directly from the buffers
+ */
+std::vector<PartialResult> runStatic(const std::vector<Chunk> &buffers,
+                                     uint32_t n_workers, size_t chunk_size,
+                                     ScanIsa isa, Cardinality cardinality,
+                                     Prefetcher *prefetcher) {
+    ChunkSchedule schedule(buffers, n_workers, chunk_size);
+    return runSchedule(schedule, n_workers, isa, cardinality, prefetcher);
+}
+
+/*
+ * \brief aggregate the single input through its sidecar index: a valid
+ * index supplies exact chunk boundaries, and with --stations only the
+ * chunks holding one of them are read; otherwise the index is built on
+ * this run
+ */
+std::vector<PartialResult> runIndexed(const Options &opts, ScanIsa isa) {
+    const MMapFile file(opts.paths[0].c_str(), opts.map);
+    struct stat st;
+    if (stat(opts.paths[0].c_str(), &st) == -1) {
+        perror(opts.paths[0].c_str());
+        exit(1);
+    }
+
+    if (const std::unique_ptr<ChunkIndex> index =
+            ChunkIndex::load(opts.index, st)) {
+        const std::vector<uint32_t> ids = index->stationIds(opts.stations);
+        std::vector<Chunk> chunks;
+        for (size_t i = 0; i < index->chunks(); ++i)
+            if (opts.stations.empty() || index->contains(i, ids))
+                chunks.push_back(index->chunk(file.begin(), i));
+        std::cerr << "Index: reading " << chunks.size() << " of "
+                  << index->chunks() << " chunks\n";
+        ChunkSchedule schedule(std::move(chunks));
+        return runSchedule(schedule, opts.n_workers, isa, opts.cardinality,
+                           nullptr);
+    }
+
+    ChunkIndex index(st, file.begin(), file.size());
+    IndexBuilder builder(index, file.begin());
+    std::vector<PartialResult> result = runSchedule(
+        builder, opts.n_workers, isa, opts.cardinality, nullptr);
+    if (index.save(opts.index))
+        std::cerr << "Index: built " << index.chunks() << " chunks\n";
+    return result;
+}
+
+/*
+ * \brief aggregate on n_workers threads while this thread runs the reader,
+ * a StreamReader or FrameReader
+ */
+template <typename Reader>
+std::vector<PartialResult> runReader(Reader &reader, uint32_t n_workers,
+                                     ScanIsa isa, Cardinality cardinality) {
+    Exchange exchange(n_workers, cardinality);
+    ResultMerger merger;
+
+    std::vector<std::future<void>> workers;
+    for (uint32_t i = 0; i < n_workers; ++i) {
+        workers.push_back(std::async(
+            std::launch::async, consumerThread<Reader>, std::ref(reader), isa,
+            std::ref(exchange), std::ref(merger), nullptr, i));
+    }
+    {
+        TRACE_SCOPE("read");
+        const StageScope read(Stage::Read);
+        reader.run();
+    }
+
+    for (auto &worker : workers)
+        worker.get();
+    return merger.take();
+}
+
+/*
+ * \brief read the inputs with explicit I/O, one after another; the only way
+ * to consume stdin, pipes and gzip input
+ */
+std::vector<PartialResult> runStream(const Options &opts, ScanIsa isa) {
+    StreamReader reader(opts.paths, opts.io, opts.io_depth, opts.io_block,
+                        opts.n_workers);
+    return runReader(reader, opts.n_workers, isa, opts.cardinality);
+}
+
+/* \brief decode the frames of zstd and lz4 files on n_workers threads */
+std::vector<PartialResult> runFrames(const Options &opts, ScanIsa isa) {
+    FrameReader reader(opts.paths, opts.map, opts.io_block, opts.n_workers,
+                       opts.n_workers);
+    return runReader(reader, opts.n_workers, isa, opts.cardinality);
+}
+
+/* \brief fold the partial files on up to n_workers threads */
+std::vector<PartialResult> runMerge(const Options &opts) {
+    ResultMerger merger;
+    std::atomic<size_t> next_file{0};
+    const auto mergeFiles = [&] {
+        const StageScope stage(Stage::Merge);
+        PartialResult res(EXPECTED_UNIQUE_STATIONS);
+        for (size_t i; (i = next_file.fetch_add(1)) < opts.paths.size();) {
+            const MMapFile file(opts.paths[i].c_str());
+            if (!decodePartial(std::string_view(file.begin(), file.size()),
+                               res)) {
+                std::cerr << opts.paths[i] << ": not a partial result file\n";
+                exit(1);
+            }
+        }
+        merger.merge(std::move(res));
+    };
+
+    std::vector<std::future<void>> workers;
+    const size_t n = std::min<size_t>(opts.n_workers, opts.paths.size());
+    for (size_t i = 0; i < n; ++i)
+        workers.push_back(std::async(std::launch::async, mergeFiles));
+    for (auto &worker : workers)
+        worker.get();
+    return merger.take();
+}
+
+/*
+ * \brief convert: a first pass aggregates the text inputs for the station
+ * dictionary and the row count of every chunk, so the second pass can parse
+ * the chunks in parallel, each writing its rows straight to their place in
+ * the columns
+ */
+int runConvert(const Options &opts, ScanIsa isa) {
+    const Timer timer;
+    InputSet inputs(opts.paths, opts.map);
+    std::vector<Chunk> chunks;
+    for (const Chunk &buffer : inputs.buffers()) {
+        const char *begin = buffer.data;
+        const char *end = buffer.data + buffer.size;
+        for (const char *itr = begin; itr < end;) {
+            const char *next = nextRowStart(itr + CONVERT_CHUNK, begin, end);
+            chunks.push_back({itr, size_t(next - itr)});
+            itr = next;
+        }
+    }
+
+    std::vector<uint64_t> first_row(chunks.size() + 1);
+    std::atomic<size_t> next_chunk{0};
+    ResultMerger merger;
+    const auto countRows = [&] {
+        PartialResult res(EXPECTED_UNIQUE_STATIONS);
+        for (size_t i; (i = next_chunk.fetch_add(1)) < chunks.size();) {
+            uint64_t rows = 0;
+            processRows(isa, chunks[i].data, chunks[i].data + chunks[i].size,
+                        [&](const char *name, size_t len, const char *value) {
+                            res.find(name, len, makeNameKey(name, len)) +=
+                                parseTemperature(value);
+                            ++rows;
+                        });
+            first_row[i + 1] = rows;
+        }
+        merger.merge(std::move(res));
+    };
+    std::vector<std::future<void>> workers;
+    for (uint32_t i = 0; i < opts.n_workers; ++i)
+        workers.push_back(std::async(std::launch::async, countRows));
+    for (auto &worker : workers)
+        worker.get();
+    for (size_t i = 0; i < chunks.size(); ++i)
+        first_row[i + 1] += first_row[i];
+
+    /* ids in name order */
+    const std::vector<PartialResult> tables = merger.take();
+    std::vector<std::string_view> names;
+    ankerl::unordered_dense::map<std::string_view, uint32_t> ids;
+    for (const auto &[name, data] : getOrderedResult(tables, opts.n_workers)) {
+        ids.emplace(name, names.size());
+        names.push_back(name);
+    }
+
+    ColumnarWriter out(opts.output.c_str(), first_row.back(), names);
+    next_chunk = 0;
+    const auto writeRows = [&] {
+        for (size_t i; (i = next_chunk.fetch_add(1)) < chunks.size();) {
+            uint64_t row = first_row[i];
+            processRows(isa, chunks[i].data, chunks[i].data + chunks[i].size,
+                        [&](const char *name, size_t len, const char *value) {
+                            out.put(row++,
+                                    ids.find(std::string_view(name, len))
+                                        ->second,
+                                    parseTemperature(value));
+                        });
+        }
+    };
+    workers.clear();
+    for (uint32_t i = 0; i < opts.n_workers; ++i)
+        workers.push_back(std::async(std::launch::async, writeRows));
+    for (auto &worker : workers)
+        worker.get();
+
+    std::cerr << "Converted " << first_row.back() << " rows of "
+              << names.size() << " stations in " << timer.elapsedMs()
+              << "ms\n";
+    return 0;
+}
+
+/*
+ * \brief aggregate columnar files: workers claim blocks and fold them into
+ * Data arrays indexed by station id, which are summed per id at the end
+ */
+std::vector<PartialResult> runColumnar(const Options &opts) {
+    const bool avx512 = hasColumnKernelAvx512();
+    std::vector<PartialResult> result;
+    result.emplace_back(EXPECTED_UNIQUE_STATIONS);
+    for (const std::string &path : opts.paths) {
+        const ColumnarFile file(path.c_str(), opts.map);
+        const size_t n_stations = file.stations().size();
+        std::vector<std::vector<Data>> partials(opts.n_workers);
+        std::atomic<uint64_t> next_block{0};
+        const auto aggregate = [&](std::vector<Data> &data) {
+            const StageScope stage(Stage::Parse);
+            data.resize(n_stations);
+            for (uint64_t b; (b = next_block.fetch_add(1)) < file.blocks();) {
+                const uint64_t begin = b * columnar::BLOCK_ROWS;
+                const uint64_t n = std::min<uint64_t>(file.rows() - begin,
+                                                      columnar::BLOCK_ROWS);
+                /* the header check cannot vouch for the ids, so every
+                 * block is checked before its ids index data */
+                const auto fold = [&](const auto *ids) {
+                    if (!idsBelow(ids + begin, n, n_stations)) {
+                        fprintf(stderr, "%s: corrupt columnar file\n",
+                                path.c_str());
+                        exit(1);
+                    }
+                    aggregateColumns(ids + begin, file.temps() + begin, n,
+                                     data.data(), avx512);
+                };
+                if (file.idWidth() == 2)
+                    fold(static_cast<const uint16_t *>(file.ids()));
+                else
+                    fold(static_cast<const uint32_t *>(file.ids()));
+            }
+        };
+
+        std::vector<std::future<void>> workers;
+        for (std::vector<Data> &data : partials)
+            workers.push_back(
+                std::async(std::launch::async, aggregate, std::ref(data)));
+        for (auto &worker : workers)
+            worker.get();
+
+        const StageScope stage(Stage::Merge);
+        for (size_t id = 0; id < n_stations; ++id) {
+            Data total;
+            for (const std::vector<Data> &data : partials)
+                total += data[id];
+            if (total.occurences > 0)
+                result[0][file.stations()[id]] += total;
+        }
+    }
+    return result;
+}
+
+/* \brief "-" is stdout */
+bool writePartial(const std::string &path,
+                  std::span<const PartialResult> result) {
+    const int fd = path == "-" ? STDOUT_FILENO
+                               : open(path.c_str(),
+                                      O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        perror(path.c_str());
+        return false;
+    }
+    const bool ok = writeAll(fd, encodePartial(result));
+    if (fd != STDOUT_FILENO && close(fd) == -1) {
+        perror(path.c_str());
+        return false;
+    }
+    return ok;
+}
+
+/* \brief the given stations of the disjoint results, as one table */
+std::vector<PartialResult>
+selectStations(std::span<const PartialResult> results,
+               const std::vector<std::string> &names) {
+    const ankerl::unordered_dense::set<std::string_view> wanted(names.begin(),
+                                                                names.end());
+    std::vector<PartialResult> selected;
+    selected.emplace_back(names.size());
+    for (const PartialResult &result : results)
+        for (const auto &[name, data] : result)
+            if (wanted.contains(name))
+                selected[0][name] += data;
+    return selected;
+}
+
+/*
+ * \brief the report on stdout, or a partial file with --partial; limited
+ * to the --stations if any
+ */
+bool writeResult(const Options &opts, std::span<const PartialResult> result) {
+    TRACE_SCOPE("output");
+    std::vector<PartialResult> selected;
+    if (!opts.stations.empty()) {
+        selected = selectStations(result, opts.stations);
+        result = selected;
+    }
+    if (!opts.partial.empty()) {
+        const StageScope stage(Stage::Output);
+        return writePartial(opts.partial, result);
+    }
+    const Result ordered = getOrderedResult(result, opts.n_workers);
+    const StageScope stage(Stage::Output);
+    return writeAll(STDOUT_FILENO, formatResult(ordered, opts.format));
+}
+
+/*
+ * \brief aggregate the complete rows of the single input after the
+ * checkpoint into it; returns the number of bytes aggregated. An input that
+ * shrank, or has no row boundary at the checkpoint any more, is aggregated
+ * from the start.
+ */
+size_t runTail(const Options &opts, ScanIsa isa, Checkpoint &ckpt) {
+    const MMapFile file(opts.paths[0].c_str(), opts.map);
+    if (ckpt.offset > file.size() ||
+        (ckpt.offset > 0 && file.begin()[ckpt.offset - 1] != '\n')) {
+        std::cerr << opts.paths[0] << ": truncated, starting over\n";
+        ckpt.offset = 0;
+        ckpt.result = PartialResult(EXPECTED_UNIQUE_STATIONS);
+    }
+    const char *begin = file.begin() + ckpt.offset;
+    const void *nl = memrchr(begin, '\n', file.size() - ckpt.offset);
+    if (nl == nullptr)
+        return 0;
+    const char *end = static_cast<const char *>(nl) + 1;
+    for (const PartialResult &res :
+         runStatic({{begin, size_t(end - begin)}}, opts.n_workers,
+                   opts.chunk_size, isa, opts.cardinality, nullptr))
+        combinePartialResult(ckpt.result, res);
+    ckpt.offset = end - file.begin();
+    return end - begin;
+}
+
+/*
+ * \brief --checkpoint / --follow: aggregate only what was appended since
+ * the checkpoint, if any, then with --follow keep watching the input and
+ * write an updated result after every append. Unterminated last rows are
+ * left for a later run, as they may still be being written.
+ */
+int runIncremental(const Options &opts, ScanIsa isa) {
+    const std::string &path = opts.paths[0];
+    Checkpoint ckpt;
+    if (!opts.checkpoint.empty())
+        loadCheckpoint(opts.checkpoint, ckpt);
+    /* watching starts before the first pass so no append goes unseen */
+    std::unique_ptr<FileWatcher> watcher;
+    if (opts.follow)
+        watcher = std::make_unique<FileWatcher>(path);
+
+    for (bool first = true;; first = false) {
+        struct stat st;
+        if (stat(path.c_str(), &st) == -1) {
+            perror(path.c_str());
+            return 1;
+        }
+        if (ckpt.dev != uint64_t(st.st_dev) ||
+            ckpt.ino != uint64_t(st.st_ino)) {
+            if (ckpt.offset > 0)
+                std::cerr << path << ": new file, starting over\n";
+            ckpt = Checkpoint();
+            ckpt.dev = st.st_dev;
+            ckpt.ino = st.st_ino;
+        }
+
+        const Timer timer;
+        const uint64_t from = ckpt.offset;
+        const size_t bytes = runTail(opts, isa, ckpt);
+        if (first || ckpt.offset != from) {
+            if (!writeResult(opts, {&ckpt.result, 1}) ||
+                (opts.follow && opts.partial.empty() &&
+                 !writeAll(STDOUT_FILENO, "\n")))
+                return 1;
+            if (!opts.checkpoint.empty() &&
+                !saveCheckpoint(opts.checkpoint, ckpt))
+                return 1;
+            std::cerr << "Aggregated " << bytes << " bytes up to offset "
+                      << ckpt.offset << " in " << timer.elapsedMs() << "ms\n";
+        }
+        if (!watcher)
+            return 0;
+        watcher->wait();
+    }
 }
 
 int main(int argc, char **argv) {
     Timer timer;
 
-    if (argc < 2 || argc > 3) {
-        std::cerr << "Usage " << argv[0] << " <input_file> [n_workers]\n";
+    Options opts;
+    if (!parseOptions(argc, argv, opts))
+        return 1;
+    if (!opts.trace.empty() && !trace::ENABLED) {
+        std::cerr << "--trace needs a build with -DONEBRC_TRACE=ON\n";
         return 1;
     }
+    TRACE_SESSION(opts.trace);
+    if (opts.counters)
+        stageCounters().enable();
 
-    MMapFile file(argv[1]);
-    const void *itr = file.data();
-    const char *end = file.end();
-    SharedQueue<Chunk> queue;
-
-    // TODO: process the very first line in the file
+    const ScanIsa isa = detectScanIsa();
+    const FaultCounter faults;
+    double map_ms = 0;
+    std::vector<PartialResult> result;
+    /*
+     * One pool of workers for all inputs: plain files are mapped into one
+     * schedule, inputs that are all zstd or lz4 are decoded frame-parallel,
+     * and any other mix is read one input after another.
+     */
+    bool all_plain = true, all_framed = true;
+    size_t n_columnar = 0;
+    for (const std::string &path : opts.paths) {
+        if (isStream(path.c_str())) {
+            all_plain = all_framed = false;
+            continue;
+        }
+        if (isColumnar(path.c_str())) {
+            all_plain = all_framed = false;
+            ++n_columnar;
+            continue;
+        }
+        const Compression compression = detectCompression(path.c_str());
+        all_plain &= compression == Compression::None;
+        all_framed &= hasIndependentFrames(compression);
+    }
+    /* columnar inputs are aggregated on their own, so any means all */
+    const bool any_columnar = n_columnar > 0;
+    if (any_columnar &&
+        (n_columnar != opts.paths.size() || opts.command != Command::Run)) {
+        std::cerr << "columnar inputs can only be aggregated, and not "
+                     "together with text inputs\n";
+        return 1;
+    }
+    if (opts.command == Command::Convert && !all_plain) {
+        std::cerr << "convert needs uncompressed files\n";
+        return 1;
+    }
+    if (opts.command == Command::Convert)
+        return runConvert(opts, isa);
+    const bool mapped = all_plain && opts.io == IoBackend::Mmap;
+    const bool ranged = opts.range_begin != 0 ||
+                        opts.range_end != std::numeric_limits<size_t>::max();
+    const bool incremental = !opts.checkpoint.empty() || opts.follow;
+    const bool indexed = !opts.index.empty();
+    if ((ranged || incremental || indexed) &&
+        (opts.command == Command::Merge || !mapped ||
+         opts.paths.size() != 1)) {
+        std::cerr << "--range, --checkpoint, --follow and --index need one "
+                     "uncompressed input and --io mmap\n";
+        return 1;
+    }
+    if (int(ranged) + int(incremental) + int(indexed) > 1) {
+        std::cerr << "--range, --checkpoint/--follow and --index cannot be "
+                     "combined\n";
+        return 1;
+    }
+    if (incremental)
+        return runIncremental(opts, isa);
 
-    // Consumers
-    const uint32_t n_consumers =
-        argc == 2 ? std::thread::hardware_concurrency() : std::stoul(argv[2]);
-    std::vector<std::future<PartialResult>> consumers;
-    for (uint32_t i = 0; i < n_consumers; ++i) {
-        consumers.push_back(
-            std::async(std::launch::async, consumerThread, std::ref(queue)));
+    std::unique_ptr<ResultCache> cache;
+    std::optional<std::vector<PartialResult>> cached;
+    if (!opts.cache.empty() && opts.command == Command::Run) {
+        cache = std::make_unique<ResultCache>(opts.cache, opts.paths,
+                                              opts.range_begin, opts.range_end,
+                                              opts.stations);
+        cached = cache->load();
     }
 
-    // Producer
-    while (itr < end) {
-        queue.push(
-            {static_cast<const char *>(itr),
-             std::min(CHUNK_SIZE, static_cast<uint32_t>(
-                                      end - static_cast<const char *>(itr)))});
-        itr = static_cast<const char *>(itr) + CHUNK_SIZE;
+    if (cached) {
+        result = std::move(*cached);
+    } else if (opts.command == Command::Merge) {
+        result = runMerge(opts);
+    } else if (any_columnar) {
+        result = runColumnar(opts);
+    } else if (all_framed) {
+        result = runFrames(opts, isa);
+    } else if (!mapped) {
+        result = runStream(opts, isa);
+    } else if (indexed) {
+        result = runIndexed(opts, isa);
+    } else {
+        StageScope map_stage(Stage::Map);
+        const Timer map_timer;
+        InputSet inputs(opts.paths, opts.map);
+        map_stage.stop();
+        map_ms = map_timer.elapsedMs();
+        std::unique_ptr<Prefetcher> prefetcher;
+        if (opts.map == MapPolicy::Prefetch && inputs.single())
+            prefetcher = std::make_unique<Prefetcher>(
+                *inputs.single(), opts.n_workers, opts.prefetch_distance);
+        else if (opts.map == MapPolicy::Prefetch)
+            std::cerr << "--map prefetch needs a single large input\n";
+
+        std::vector<Chunk> buffers = inputs.buffers();
+        if (ranged) {
+            /* own the rows that start in the range, see chunk.hpp */
+            const char *begin = buffers[0].data;
+            const char *end = begin + buffers[0].size;
+            const char *first = nextRowStart(
+                begin + std::min(opts.range_begin, buffers[0].size), begin,
+                end);
+            const char *last = nextRowStart(
+                begin + std::min(opts.range_end, buffers[0].size), begin, end);
+            buffers[0] = {first, size_t(last - first)};
+        }
+        if (opts.mode == Mode::Static)
+            result = runStatic(buffers, opts.n_workers, opts.chunk_size, isa,
+                               opts.cardinality, prefetcher.get());
+        else if (opts.queue == QueueKind::Mutex)
+            result = runQueued<SharedQueue<Chunk>>(
+                buffers, opts.n_workers, opts.chunk_size, isa,
+                opts.cardinality, prefetcher.get());
+        else
+            result = runQueued<RingQueue<Chunk>>(
+                buffers, opts.n_workers, opts.chunk_size, isa,
+                opts.cardinality, prefetcher.get());
     }
 
-    // Wait consumers and merge results
-    PartialResult result;
-    for (uint32_t i = 0; i < n_consumers; ++i)
-        queue.push(sentinel);
-    for (auto &consumer : consumers)
-        combinePartialResult(result, consumer.get());
+    if (cache && !cached)
+        cache->store(result);
 
     // Final output
-    for (const auto &[name, data] : getOrderedResult(result))
-        std::cout << name << ": " << data.min << "/"
-                  << data.sum / data.occurences << "/" << data.max << "\n";
+    if (!writeResult(opts, result))
+        return 1;
 
     const double ms = timer.elapsedMs();
-    std::cout << "Took: " << ms << "ms\n";
+    std::cerr << "Took: " << ms << "ms\n";
+    std::cerr << "Faults: " << faults.minor() << " minor, " << faults.major()
+              << " major";
+    if (mapped && opts.command == Command::Run && !cached && !indexed)
+        std::cerr << " (map " << mapPolicyName(opts.map) << ", " << map_ms
+                  << "ms to map inputs)";
+    std::cerr << "\n";
+    if (cached)
+        std::cerr << "Cache: hit " << cache->path() << "\n";
+    else if (cache && cache->cacheable())
+        std::cerr << "Cache: miss, stored " << cache->path() << "\n";
+    else if (cache)
+        std::cerr << "Cache: uncacheable input\n";
+    if (opts.counters) {
+        uint64_t rows = 0;
+        for (const PartialResult &res : result)
+            for (const auto &[name, data] : res)
+                rows += data.occurences;
+        stageCounters().report(rows);
+    }
 
     return 0;
 }
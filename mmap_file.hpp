@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -8,30 +9,86 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include "chunk.hpp"
+
+/*
+ * How the mapping is faulted in:
+ *  - Plain: on demand, one minor fault per 4 KB page
+ *  - Populate: MAP_POPULATE, every page table entry is set up in mmap()
+ *  - Sequential / WillNeed: the matching madvise() readahead hints
+ *  - HugePage: 2 MB aligned mapping with MADV_HUGEPAGE; whether file pages
+ *    really end up in huge pages depends on the kernel (read-only THP for
+ *    file mappings)
+ *  - Prefetch: a plain mapping; a Prefetcher thread populates it ahead of
+ *    the workers
+ */
+enum class MapPolicy {
+    Plain,
+    Populate,
+    Sequential,
+    WillNeed,
+    HugePage,
+    Prefetch
+};
+
+inline const char *mapPolicyName(MapPolicy policy) {
+    switch (policy) {
+    case MapPolicy::Populate:
+        return "populate";
+    case MapPolicy::Sequential:
+        return "sequential";
+    case MapPolicy::WillNeed:
+        return "willneed";
+    case MapPolicy::HugePage:
+        return "hugepage";
+    case MapPolicy::Prefetch:
+        return "prefetch";
+    default:
+        return "plain";
+    }
+}
+
+/*
+ * Read-only mapping of a whole file followed by at least CHUNK_PADDING
+ * zero bytes: an anonymous region is reserved first and the file is mapped
+ * over its start, so fixed-width loads at the end of the data never fault.
+ */
 class MMapFile {
   public:
-    MMapFile(const char *path) {
+    static constexpr size_t HUGE_PAGE = 2 * 1024 * 1024;
+
+    MMapFile(const char *path, MapPolicy policy = MapPolicy::Plain) {
         fd = open(path, O_RDONLY);
         if (fd == -1) {
             perror("open");
             exit(1);
         }
 
-        length = lseek(fd, 0, SEEK_END);
-        if (length == (off_t)-1) {
+        const off_t file_length = lseek(fd, 0, SEEK_END);
+        if (file_length == (off_t)-1) {
             perror("lseek");
             exit(1);
         }
+        length = file_length;
 
-        ptr = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
-        if (ptr == MAP_FAILED) {
+        const size_t page = sysconf(_SC_PAGESIZE);
+        const size_t align = policy == MapPolicy::HugePage ? HUGE_PAGE : page;
+        mapped = (length + CHUNK_PADDING + page - 1) / page * page;
+        reserve(mapped, align);
+
+        const int flags = MAP_PRIVATE | MAP_FIXED |
+                          (policy == MapPolicy::Populate ? MAP_POPULATE : 0);
+        if (length > 0 &&
+            mmap(ptr, length, PROT_READ, flags, fd, 0) == MAP_FAILED) {
             perror("mmap");
             exit(1);
         }
+        if (length > 0)
+            advise(policy);
     }
 
     ~MMapFile() {
-        if (munmap(ptr, length) == -1) {
+        if (munmap(ptr, mapped) == -1) {
             perror("munmap");
             exit(1);
         }
@@ -49,7 +106,47 @@ class MMapFile {
     size_t size() const { return length; }
 
   private:
+    /* \brief anonymous zero region of size bytes starting on an align
+     * boundary */
+    void reserve(size_t size, size_t align) {
+        const size_t over = size + align - sysconf(_SC_PAGESIZE);
+        char *base = static_cast<char *>(mmap(
+            NULL, over, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        if (base == MAP_FAILED) {
+            perror("mmap");
+            exit(1);
+        }
+        char *start = reinterpret_cast<char *>(
+            (reinterpret_cast<uintptr_t>(base) + align - 1) / align * align);
+        if (start > base)
+            munmap(base, start - base);
+        if (base + over > start + size)
+            munmap(start + size, base + over - (start + size));
+        ptr = start;
+    }
+
+    void advise(MapPolicy policy) {
+        int advice;
+        switch (policy) {
+        case MapPolicy::Sequential:
+            advice = MADV_SEQUENTIAL;
+            break;
+        case MapPolicy::WillNeed:
+            advice = MADV_WILLNEED;
+            break;
+        case MapPolicy::HugePage:
+            advice = MADV_HUGEPAGE;
+            break;
+        default:
+            return;
+        }
+        /* only a hint: an unsupported advice keeps the plain mapping */
+        if (madvise(ptr, length, advice) == -1)
+            perror("madvise");
+    }
+
     void *ptr = nullptr;
     size_t length = 0;
+    size_t mapped = 0;
     int fd = -1;
 };
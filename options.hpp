@@ -0,0 +1,264 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <glob.h>
+#include <limits>
+#include <optional>
+#include <iostream>
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "chunk_schedule.hpp"
+#include "exchange.hpp"
+#include "mmap_file.hpp"
+#include "output.hpp"
+#include "parse_size.hpp"
+#include "stream_reader.hpp"
+
+constexpr uint32_t MAX_IO_DEPTH = 4096;
+constexpr size_t MAX_IO_BLOCK = size_t(1) << 30;
+
+enum class Command { Run, Merge, Convert };
+enum class Mode { Queue, Static };
+enum class QueueKind { Mutex, Ring };
+
+struct Options {
+    Command command = Command::Run;
+    std::vector<std::string> paths;
+    uint32_t n_workers = std::thread::hardware_concurrency();
+    Mode mode = Mode::Static;
+    QueueKind queue = QueueKind::Ring;
+    Cardinality cardinality = Cardinality::Auto;
+    OutputFormat format = OutputFormat::Lines;
+    IoBackend io = IoBackend::Mmap;
+    MapPolicy map = MapPolicy::Plain;
+    /* bytes per chunk of the mmap path (the least for --mode static) */
+    size_t chunk_size = 128 * 1024;
+    size_t prefetch_distance = 128 * 1024 * 1024;
+    uint32_t io_depth = 8;
+    size_t io_block = 1024 * 1024;
+    /* rows starting in [range_begin, range_end) of a single input */
+    size_t range_begin = 0;
+    size_t range_end = std::numeric_limits<size_t>::max();
+    /* write a binary partial result here instead of the report */
+    std::string partial;
+    /* directory of cached final aggregates, none if empty */
+    std::string cache;
+    /* resume from and update this checkpoint, see checkpoint.hpp */
+    std::string checkpoint;
+    /* keep aggregating rows appended to the input */
+    bool follow = false;
+    /* sidecar index of the input, see chunk_index.hpp */
+    std::string index;
+    /* report only these stations */
+    std::vector<std::string> stations;
+    /* columnar file written by the convert command */
+    std::string output;
+    /* Chrome trace of an ONEBRC_TRACE build, see trace.hpp */
+    std::string trace;
+    /* report perf_event_open counters per pipeline stage */
+    bool counters = false;
+};
+
+inline void printUsage(const char *prog) {
+    std::cerr << "Usage " << prog
+              << " [merge|convert] [--mode static|queue] [--queue mutex|ring]"
+                 " [--cardinality auto|low|high] [--format lines|canonical]"
+                 " [--io mmap|uring|pread] [--io-depth N] [--io-block SIZE]"
+                 " [--map plain|populate|sequential|willneed|hugepage|prefetch]"
+                 " [--prefetch-distance SIZE] [--chunk-size SIZE]"
+                 " [--range START:[END]]"
+                 " [--partial FILE|-] [--cache DIR] [--checkpoint FILE]"
+                 " [--follow] [--index FILE] [--stations NAME[;NAME]...]"
+                 " [--trace FILE] [--counters]"
+                 " <input_file|glob|->... [n_workers]\n"
+              << "merge combines partial files written with --partial\n"
+              << "convert --output FILE writes the inputs in columnar form\n";
+}
+
+/*
+ * \brief "<start>:[<end>]" in parseSize units, an empty end is the end of
+ * the input; nullopt if malformed or empty
+ */
+inline std::optional<std::pair<size_t, size_t>>
+parseRange(std::string_view value) {
+    const size_t colon = value.find(':');
+    if (colon == value.npos)
+        return std::nullopt;
+    const std::string_view first = value.substr(0, colon);
+    const std::string_view last = value.substr(colon + 1);
+    const size_t begin = first == "0" ? 0 : parseSize(first);
+    const size_t end = last.empty() ? std::numeric_limits<size_t>::max()
+                                    : parseSize(last);
+    if ((begin == 0 && first != "0") || end <= begin)
+        return std::nullopt;
+    return std::make_pair(begin, end);
+}
+
+/*
+ * \brief append the files matching pattern, in sorted order; a pattern
+ * without wildcards, or that names an existing file, is taken literally
+ */
+inline bool expandInput(const std::string &pattern,
+                        std::vector<std::string> &paths) {
+    if (pattern.find_first_of("*?[") == pattern.npos ||
+        access(pattern.c_str(), F_OK) == 0) {
+        paths.push_back(pattern);
+        return true;
+    }
+    glob_t matches;
+    if (glob(pattern.c_str(), 0, nullptr, &matches) != 0) {
+        std::cerr << "No input matches " << pattern << "\n";
+        return false;
+    }
+    for (size_t i = 0; i < matches.gl_pathc; ++i)
+        paths.emplace_back(matches.gl_pathv[i]);
+    globfree(&matches);
+    return true;
+}
+
+/*
+ * \brief parse "--flag value" / "--flag=value" options and the positional
+ * inputs (paths, globs or "-") with an optional trailing [n_workers]; a last
+ * positional made of digits is n_workers unless a file of that name exists.
+ * A first argument "merge" selects the merge command, whose inputs are
+ * partial files, and "convert" the conversion to columnar form, which needs
+ * --output. Prints usage and returns false on error.
+ */
+inline bool parseOptions(int argc, char **argv, Options &opts) {
+    std::vector<std::string> positional;
+    int i = 1;
+    if (argc > 1 && std::string_view(argv[1]) == "merge") {
+        opts.command = Command::Merge;
+        ++i;
+    } else if (argc > 1 && std::string_view(argv[1]) == "convert") {
+        opts.command = Command::Convert;
+        ++i;
+    }
+    for (; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg.size() < 2 || arg.substr(0, 2) != "--") {
+            positional.emplace_back(arg);
+            continue;
+        }
+
+        std::string_view name = arg.substr(2), value;
+        if (name == "follow") {
+            opts.follow = true;
+            continue;
+        }
+        if (name == "counters") {
+            opts.counters = true;
+            continue;
+        }
+        if (const size_t eq = name.find('='); eq != name.npos) {
+            value = name.substr(eq + 1);
+            name = name.substr(0, eq);
+        } else if (i + 1 < argc) {
+            value = argv[++i];
+        }
+
+        if (name == "mode" && value == "static") {
+            opts.mode = Mode::Static;
+        } else if (name == "mode" && value == "queue") {
+            opts.mode = Mode::Queue;
+        } else if (name == "queue" && value == "mutex") {
+            opts.queue = QueueKind::Mutex;
+        } else if (name == "queue" && value == "ring") {
+            opts.queue = QueueKind::Ring;
+        } else if (name == "cardinality" && value == "auto") {
+            opts.cardinality = Cardinality::Auto;
+        } else if (name == "cardinality" && value == "low") {
+            opts.cardinality = Cardinality::Low;
+        } else if (name == "cardinality" && value == "high") {
+            opts.cardinality = Cardinality::High;
+        } else if (name == "format" && value == "lines") {
+            opts.format = OutputFormat::Lines;
+        } else if (name == "format" && value == "canonical") {
+            opts.format = OutputFormat::Canonical;
+        } else if (name == "io" && value == "mmap") {
+            opts.io = IoBackend::Mmap;
+        } else if (name == "io" && value == "uring") {
+            opts.io = IoBackend::Uring;
+        } else if (name == "io" && value == "pread") {
+            opts.io = IoBackend::Pread;
+        } else if (name == "map" && value == "plain") {
+            opts.map = MapPolicy::Plain;
+        } else if (name == "map" && value == "populate") {
+            opts.map = MapPolicy::Populate;
+        } else if (name == "map" && value == "sequential") {
+            opts.map = MapPolicy::Sequential;
+        } else if (name == "map" && value == "willneed") {
+            opts.map = MapPolicy::WillNeed;
+        } else if (name == "map" && value == "hugepage") {
+            opts.map = MapPolicy::HugePage;
+        } else if (name == "map" && value == "prefetch") {
+            opts.map = MapPolicy::Prefetch;
+        } else if (name == "prefetch-distance" && parseSize(value) > 0) {
+            opts.prefetch_distance = parseSize(value);
+        } else if (name == "chunk-size" && parseSize(value) > 0 &&
+                   parseSize(value) <= ChunkSchedule::DEFAULT_MAX_CHUNK) {
+            opts.chunk_size = parseSize(value);
+        } else if (name == "io-depth" && parseSize(value) > 0 &&
+                   parseSize(value) <= MAX_IO_DEPTH) {
+            opts.io_depth = parseSize(value);
+        } else if (name == "io-block" && parseSize(value) > 0 &&
+                   parseSize(value) <= MAX_IO_BLOCK) {
+            opts.io_block = parseSize(value);
+        } else if (name == "range" && parseRange(value)) {
+            std::tie(opts.range_begin, opts.range_end) = *parseRange(value);
+        } else if (name == "partial" && !value.empty()) {
+            opts.partial = value;
+        } else if (name == "cache" && !value.empty()) {
+            opts.cache = value;
+        } else if (name == "checkpoint" && !value.empty()) {
+            opts.checkpoint = value;
+        } else if (name == "output" && !value.empty()) {
+            opts.output = value;
+        } else if (name == "trace" && !value.empty()) {
+            opts.trace = value;
+        } else if (name == "index" && !value.empty()) {
+            opts.index = value;
+        } else if (name == "stations" && !value.empty()) {
+            /* names cannot contain ';', the row separator */
+            for (size_t start = 0; start <= value.size();) {
+                const size_t end = std::min(value.find(';', start),
+                                            value.size());
+                opts.stations.emplace_back(value.substr(start, end - start));
+                start = end + 1;
+            }
+        } else {
+            std::cerr << "Unknown option: " << arg << "\n";
+            printUsage(argv[0]);
+            return false;
+        }
+    }
+
+    if (positional.size() >= 2) {
+        const std::string &last = positional.back();
+        if (last.find_first_not_of("0123456789") == last.npos &&
+            access(last.c_str(), F_OK) != 0) {
+            /* too many to be a thread count: 0, a usage error below */
+            const size_t n_workers = parseCount(last);
+            opts.n_workers = n_workers <= UINT32_MAX ? n_workers : 0;
+            positional.pop_back();
+        }
+    }
+    for (const std::string &input : positional)
+        if (!expandInput(input, opts.paths))
+            return false;
+
+    if (opts.paths.empty() || opts.n_workers == 0 ||
+        (opts.command == Command::Convert) == opts.output.empty()) {
+        printUsage(argv[0]);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <charconv>
+#include <cstdint>
+#include <stdio.h>
+#include <string>
+#include <string.h>
+#include <string_view>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "data.hpp"
+
+using Result = std::vector<std::pair<std::string_view, Data>>;
+
+enum class OutputFormat { Lines, Canonical };
+
+/* "-99.9" plus separators: an upper bound on the bytes of one value */
+constexpr size_t MAX_TENTHS_LENGTH = 24;
+
+/* \brief emit fixed-point tenths as a one-decimal number, e.g. -12.3 */
+inline char *formatTenths(char *out, int64_t tenths) {
+    uint64_t abs_value = uint64_t(tenths);
+    if (tenths < 0) {
+        *out++ = '-';
+        abs_value = 0 - abs_value;
+    }
+    out = std::to_chars(out, out + MAX_TENTHS_LENGTH, abs_value / 10).ptr;
+    *out++ = '.';
+    *out++ = char('0' + abs_value % 10);
+    return out;
+}
+
+/*
+ * \brief format the ordered result into one buffer, sized up front
+ *
+ * Lines:     "<name>: <min>/<mean>/<max>\n" per station
+ * Canonical: "{<name>=<min>/<mean>/<max>, ...}\n" as in the reference
+ *            1BRC implementation
+ */
+inline std::string formatResult(const Result &result, OutputFormat format) {
+    size_t capacity = 4;
+    for (const auto &[name, data] : result)
+        capacity += name.size() + 3 * MAX_TENTHS_LENGTH + 4;
+
+    std::string buf(capacity, '\0');
+    char *out = buf.data();
+    const bool canonical = format == OutputFormat::Canonical;
+    if (canonical)
+        *out++ = '{';
+    for (size_t i = 0; i < result.size(); ++i) {
+        const auto &[name, data] = result[i];
+        if (canonical && i > 0) {
+            *out++ = ',';
+            *out++ = ' ';
+        }
+        memcpy(out, name.data(), name.size());
+        out += name.size();
+        if (canonical) {
+            *out++ = '=';
+        } else {
+            *out++ = ':';
+            *out++ = ' ';
+        }
+        out = formatTenths(out, data.min);
+        *out++ = '/';
+        out = formatTenths(out, data.mean());
+        *out++ = '/';
+        out = formatTenths(out, data.max);
+        if (!canonical)
+            *out++ = '\n';
+    }
+    if (canonical) {
+        *out++ = '}';
+        *out++ = '\n';
+    }
+    buf.resize(out - buf.data());
+    return buf;
+}
+
+/* \brief one write(2) for the whole buffer, repeated only on short writes */
+inline bool writeAll(int fd, std::string_view buf) {
+    while (!buf.empty()) {
+        const ssize_t n = write(fd, buf.data(), buf.size());
+        if (n < 0) {
+            perror("write");
+            return false;
+        }
+        buf.remove_prefix(n);
+    }
+    return true;
+}
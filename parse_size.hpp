@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+namespace detail {
+
+/*
+ * \brief "<n>[K|M|G]", each suffix a further factor of unit; 0 if
+ * malformed or out of range
+ */
+inline size_t parseScaled(std::string_view value, size_t unit) {
+    size_t n = 0, i = 0;
+    for (; i < value.size() && value[i] >= '0' && value[i] <= '9'; ++i)
+        if (__builtin_mul_overflow(n, 10, &n) ||
+            __builtin_add_overflow(n, value[i] - '0', &n))
+            return 0;
+    if (i == 0 || i + 1 < value.size())
+        return 0;
+    if (i == value.size())
+        return n;
+    size_t factor;
+    switch (value[i]) {
+    case 'K':
+    case 'k':
+        factor = unit;
+        break;
+    case 'M':
+    case 'm':
+        factor = unit * unit;
+        break;
+    case 'G':
+    case 'g':
+        factor = unit * unit * unit;
+        break;
+    default:
+        return 0;
+    }
+    return __builtin_mul_overflow(n, factor, &n) ? 0 : n;
+}
+
+} // namespace detail
+
+/* \brief "<n>[K|M|G]" in bytes, binary multiples, 0 if malformed */
+inline size_t parseSize(std::string_view value) {
+    return detail::parseScaled(value, 1024);
+}
+
+/* \brief "<n>[K|M|G]" as a count, decimal multiples, 0 if malformed */
+inline size_t parseCount(std::string_view value) {
+    return detail::parseScaled(value, 1000);
+}
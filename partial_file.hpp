@@ -0,0 +1,176 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <fcntl.h>
+#include <span>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "data.hpp"
+#include "io_util.hpp"
+#include "output.hpp"
+#include "result_merger.hpp"
+
+/*
+ * Binary serialization of partial results, for merging runs over byte
+ * ranges of one input in other processes or on other hosts.
+ *
+ * Layout (little-endian, no padding between fields):
+ *   header   "1BRCPART", uint32 version, uint64 record count,
+ *            uint64 string table size
+ *   records  count x { uint64 name offset, uint32 name length,
+ *            int64 sum, uint32 count, int16 min, int16 max }
+ *   strings  the names, back to back, addressed by the records
+ *
+ * Values stay in fixed-point tenths, so merging partial files is as exact
+ * as merging in memory.
+ */
+namespace partial {
+
+static_assert(std::endian::native == std::endian::little,
+              "the partial format is written in host byte order");
+
+constexpr char MAGIC[8] = {'1', 'B', 'R', 'C', 'P', 'A', 'R', 'T'};
+constexpr uint32_t VERSION = 2;
+constexpr size_t HEADER_SIZE = sizeof(MAGIC) + 4 + 8 + 8;
+constexpr size_t RECORD_SIZE = 8 + 4 + 8 + 4 + 2 + 2;
+
+template <typename T> inline char *put(char *p, T value) {
+    memcpy(p, &value, sizeof(value));
+    return p + sizeof(value);
+}
+
+template <typename T> inline const char *get(const char *p, T &value) {
+    memcpy(&value, p, sizeof(value));
+    return p + sizeof(value);
+}
+
+} // namespace partial
+
+/* \brief results with disjoint key sets, as returned by ResultMerger */
+inline std::string encodePartial(std::span<const PartialResult> results) {
+    size_t count = 0, names = 0;
+    for (const PartialResult &result : results) {
+        count += result.size();
+        for (const auto &[name, data] : result)
+            names += name.size();
+    }
+
+    std::string out(partial::HEADER_SIZE + count * partial::RECORD_SIZE + names,
+                    '\0');
+    char *p = out.data();
+    memcpy(p, partial::MAGIC, sizeof(partial::MAGIC));
+    p += sizeof(partial::MAGIC);
+    p = partial::put(p, partial::VERSION);
+    p = partial::put(p, uint64_t(count));
+    p = partial::put(p, uint64_t(names));
+
+    char *strings = p + count * partial::RECORD_SIZE;
+    uint64_t offset = 0;
+    for (const PartialResult &result : results) {
+        for (const auto &[name, data] : result) {
+            p = partial::put(p, offset);
+            p = partial::put(p, uint32_t(name.size()));
+            p = partial::put(p, data.sum);
+            p = partial::put(p, data.occurences);
+            p = partial::put(p, data.min);
+            p = partial::put(p, data.max);
+            memcpy(strings + offset, name.data(), name.size());
+            offset += name.size();
+        }
+    }
+    return out;
+}
+
+/*
+ * \brief fold an encoded partial result into table; returns false, leaving
+ * table untouched, if bytes is not a well-formed partial result
+ */
+inline bool decodePartial(std::string_view bytes, PartialResult &table) {
+    if (bytes.size() < partial::HEADER_SIZE ||
+        memcmp(bytes.data(), partial::MAGIC, sizeof(partial::MAGIC)) != 0)
+        return false;
+    const char *p = bytes.data() + sizeof(partial::MAGIC);
+    uint32_t version;
+    uint64_t count, names;
+    p = partial::get(p, version);
+    p = partial::get(p, count);
+    p = partial::get(p, names);
+    /* bound the counts by the input size before multiplying them */
+    if (version != partial::VERSION || count > bytes.size() ||
+        names > bytes.size() ||
+        bytes.size() !=
+            partial::HEADER_SIZE + count * partial::RECORD_SIZE + names)
+        return false;
+
+    const char *strings = p + size_t(count) * partial::RECORD_SIZE;
+    for (const char *r = p; r < strings; r += partial::RECORD_SIZE) {
+        uint64_t offset;
+        uint32_t len;
+        partial::get(partial::get(r, offset), len);
+        if (offset > names || len > names - offset)
+            return false;
+    }
+
+    PartialResult decoded(count);
+    for (uint64_t i = 0; i < count; ++i) {
+        uint64_t offset;
+        uint32_t len;
+        Data data;
+        p = partial::get(p, offset);
+        p = partial::get(p, len);
+        p = partial::get(p, data.sum);
+        p = partial::get(p, data.occurences);
+        p = partial::get(p, data.min);
+        p = partial::get(p, data.max);
+        decoded[std::string_view(strings + offset, len)] += data;
+    }
+    combinePartialResult(table, decoded);
+    return true;
+}
+
+/* \brief the whole file at path; false if it cannot be opened */
+inline bool readFile(const std::string &path, std::string &bytes) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1)
+        return false;
+    struct stat st;
+    bytes.clear();
+    if (fstat(fd, &st) == 0) {
+        bytes.resize(st.st_size);
+        bytes.resize(preadFull(fd, bytes.data(), bytes.size(), 0));
+    }
+    close(fd);
+    return true;
+}
+
+/*
+ * \brief replace the file at path by parts, written to a temporary file and
+ * renamed, so concurrent readers never see a torn file; reports and returns
+ * false on error
+ */
+inline bool replaceFile(const std::string &path,
+                        const std::vector<std::string_view> &parts) {
+    const std::string tmp = path + "." + std::to_string(getpid());
+    const int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        perror(tmp.c_str());
+        return false;
+    }
+    bool ok = true;
+    for (const std::string_view part : parts)
+        ok = ok && writeAll(fd, part);
+    if (close(fd) == -1 || !ok || rename(tmp.c_str(), path.c_str()) == -1) {
+        perror(path.c_str());
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
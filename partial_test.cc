@@ -0,0 +1,107 @@
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <string>
+#include <string_view>
+
+#include "partial_file.hpp"
+
+/*
+ * partial_test: tables survive encodePartial and decodePartial unchanged,
+ * and truncated or inconsistent encodings are rejected without touching
+ * the table they would have been folded into.
+ */
+
+using Expected = std::map<std::string, Data, std::less<>>;
+
+Expected contents(const PartialResult &table) {
+    Expected all;
+    for (const auto &[name, data] : table)
+        all[std::string(name)] = data;
+    return all;
+}
+
+bool same(const Expected &lhs, const Expected &rhs) {
+    if (lhs.size() != rhs.size())
+        return false;
+    for (const auto &[name, data] : lhs) {
+        const auto it = rhs.find(name);
+        if (it == rhs.end() || it->second.sum != data.sum ||
+            it->second.occurences != data.occurences ||
+            it->second.min != data.min || it->second.max != data.max)
+            return false;
+    }
+    return true;
+}
+
+int main() {
+    int failures = 0;
+    const auto expect = [&](bool ok, const char *what) {
+        if (!ok) {
+            std::cout << "FAIL: " << what << "\n";
+            ++failures;
+        }
+    };
+
+    PartialResult table;
+    for (int i = 0; i < 1000; ++i)
+        table["station " + std::to_string(i % 97)] += int16_t(i % 1999 - 999);
+    table[std::string(300, 'x')] += int16_t(-999);
+    table[""] += int16_t(5);
+    const std::string bytes = encodePartial({&table, 1});
+
+    PartialResult decoded;
+    expect(decodePartial(bytes, decoded) &&
+               same(contents(decoded), contents(table)),
+           "round trip");
+
+    /* decoding folds into what the table already holds */
+    expect(decodePartial(bytes, decoded), "second decode");
+    Expected doubled = contents(table);
+    for (auto &[name, data] : doubled)
+        data += Data(data);
+    expect(same(contents(decoded), doubled), "decode into a non-empty table");
+
+    PartialResult empty;
+    expect(decodePartial(encodePartial({}), empty) && empty.size() == 0,
+           "empty round trip");
+
+    const auto rejected = [&](std::string_view corrupt, const char *what) {
+        PartialResult target;
+        target["kept"] += int16_t(1);
+        expect(!decodePartial(corrupt, target) && target.size() == 1 &&
+                   target["kept"].occurences == 1,
+               what);
+    };
+
+    for (size_t n = 0; n < bytes.size(); ++n)
+        if (decodePartial(bytes.substr(0, n), empty) || empty.size() != 0) {
+            std::cout << "FAIL: truncated to " << n << " bytes\n";
+            ++failures;
+            break;
+        }
+    rejected(bytes + '\0', "trailing byte");
+
+    const size_t record = partial::HEADER_SIZE;
+    std::string corrupt = bytes;
+    partial::put(corrupt.data() + record, uint64_t(1) << 40);
+    rejected(corrupt, "name offset past the strings");
+
+    corrupt = bytes;
+    partial::put(corrupt.data() + record + 8, uint32_t(0xFFFFFFFF));
+    rejected(corrupt, "name length past the strings");
+
+    corrupt = bytes;
+    partial::put(corrupt.data() + sizeof(partial::MAGIC), uint32_t(1));
+    rejected(corrupt, "old version");
+
+    corrupt = bytes;
+    partial::put(corrupt.data() + sizeof(partial::MAGIC) + 4,
+                 uint64_t(1) << 60);
+    rejected(corrupt, "record count overflowing the size");
+
+    corrupt = bytes;
+    corrupt[0] = 'X';
+    rejected(corrupt, "magic");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,323 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/*
+ * Hardware counters (and page faults) of the calling thread through
+ * perf_event_open, user space only. Every event is opened on its own, so
+ * one the CPU or the kernel does not offer (virtual machines,
+ * perf_event_paranoid) is simply missing from the samples instead of
+ * failing the rest; without any of them available() is false and the
+ * counters cost nothing.
+ *
+ * Counts run from enable() and are read without stopping them: the cost of
+ * a stage is the difference of the samples taken around it. Multiplexed
+ * counts are scaled by the time the event was actually counting.
+ */
+enum class PerfEvent {
+    Cycles,
+    Instructions,
+    BranchMisses,
+    L1dMisses,
+    LlcMisses,
+    DtlbMisses,
+    PageFaults,
+};
+
+constexpr size_t PERF_EVENTS = 7;
+
+inline const char *perfEventName(PerfEvent event) {
+    switch (event) {
+    case PerfEvent::Cycles:
+        return "cycles";
+    case PerfEvent::Instructions:
+        return "instructions";
+    case PerfEvent::BranchMisses:
+        return "branch-misses";
+    case PerfEvent::L1dMisses:
+        return "L1d-misses";
+    case PerfEvent::LlcMisses:
+        return "LLC-misses";
+    case PerfEvent::DtlbMisses:
+        return "dTLB-misses";
+    default:
+        return "page-faults";
+    }
+}
+
+namespace detail {
+
+/* \brief read misses of a PERF_TYPE_HW_CACHE cache */
+constexpr uint64_t cacheMisses(uint64_t cache) {
+    return cache | PERF_COUNT_HW_CACHE_OP_READ << 8 |
+           PERF_COUNT_HW_CACHE_RESULT_MISS << 16;
+}
+
+struct PerfEventConfig {
+    uint32_t type;
+    uint64_t config;
+};
+
+/* in PerfEvent order */
+inline constexpr PerfEventConfig PERF_EVENT_CONFIGS[PERF_EVENTS] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {PERF_TYPE_HW_CACHE, cacheMisses(PERF_COUNT_HW_CACHE_L1D)},
+    {PERF_TYPE_HW_CACHE, cacheMisses(PERF_COUNT_HW_CACHE_LL)},
+    {PERF_TYPE_HW_CACHE, cacheMisses(PERF_COUNT_HW_CACHE_DTLB)},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+};
+
+} // namespace detail
+
+struct PerfSample {
+    std::array<uint64_t, PERF_EVENTS> counts = {};
+
+    uint64_t operator[](PerfEvent event) const {
+        return counts[size_t(event)];
+    }
+
+    PerfSample operator-(const PerfSample &rhs) const {
+        PerfSample diff;
+        for (size_t i = 0; i < PERF_EVENTS; ++i)
+            diff.counts[i] = counts[i] - rhs.counts[i];
+        return diff;
+    }
+
+    PerfSample &operator+=(const PerfSample &rhs) {
+        for (size_t i = 0; i < PERF_EVENTS; ++i)
+            counts[i] += rhs.counts[i];
+        return *this;
+    }
+};
+
+class PerfCounters {
+  public:
+    /* \brief open the events for the calling thread, stopped */
+    PerfCounters() {
+        for (size_t i = 0; i < PERF_EVENTS; ++i) {
+            perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = detail::PERF_EVENT_CONFIGS[i].type;
+            attr.config = detail::PERF_EVENT_CONFIGS[i].config;
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                               PERF_FORMAT_TOTAL_TIME_RUNNING;
+            fds[i] = int(syscall(__NR_perf_event_open, &attr, 0, -1, -1,
+                                 PERF_FLAG_FD_CLOEXEC));
+            if (fds[i] == -1)
+                open_errno = errno;
+        }
+    }
+
+    ~PerfCounters() {
+        for (const int fd : fds)
+            if (fd != -1)
+                close(fd);
+    }
+
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    bool available(PerfEvent event) const {
+        return fds[size_t(event)] != -1;
+    }
+
+    bool available() const {
+        for (const int fd : fds)
+            if (fd != -1)
+                return true;
+        return false;
+    }
+
+    /* \brief errno of the last event that failed to open, 0 if none */
+    int error() const { return open_errno; }
+
+    void enable() {
+        for (const int fd : fds)
+            if (fd != -1)
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    void disable() {
+        for (const int fd : fds)
+            if (fd != -1)
+                ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    }
+
+    /* \brief counts since construction; 0 for missing events */
+    PerfSample read() const {
+        PerfSample sample;
+        for (size_t i = 0; i < PERF_EVENTS; ++i) {
+            uint64_t values[3];
+            if (fds[i] == -1 ||
+                ::read(fds[i], values, sizeof(values)) != sizeof(values))
+                continue;
+            const auto [count, enabled, running] = values;
+            sample.counts[i] =
+                running == 0 || running == enabled
+                    ? count
+                    : uint64_t(double(count) * enabled / running);
+        }
+        return sample;
+    }
+
+  private:
+    std::array<int, PERF_EVENTS> fds;
+    int open_errno = 0;
+};
+
+/* the pipeline stages reported by --counters */
+enum class Stage { Map, Read, Parse, Merge, Sort, Output };
+
+constexpr size_t STAGES = 6;
+
+inline const char *stageName(Stage stage) {
+    switch (stage) {
+    case Stage::Map:
+        return "map";
+    case Stage::Read:
+        return "read";
+    case Stage::Parse:
+        return "parse";
+    case Stage::Merge:
+        return "merge";
+    case Stage::Sort:
+        return "sort";
+    default:
+        return "output";
+    }
+}
+
+/*
+ * Per-stage sums of the counters of every thread, for --counters. Each
+ * thread opens its own PerfCounters on first use; a StageScope adds what
+ * its thread counted between construction and stop() to the stage. While
+ * disabled a scope costs one branch.
+ */
+class StageCounters {
+  public:
+    void enable() { enabled = true; }
+    bool isEnabled() const { return enabled; }
+
+    /* \brief the running counters of the calling thread */
+    static const PerfCounters &local() {
+        thread_local PerfCounters counters;
+        thread_local const bool started = (counters.enable(), true);
+        (void)started;
+        return counters;
+    }
+
+    void add(Stage stage, const PerfSample &sample) {
+        std::lock_guard lk(mtx);
+        sums[size_t(stage)] += sample;
+        ++scopes[size_t(stage)];
+    }
+
+    /* \brief print the stages that ran, rates per input row, to stderr */
+    void report(uint64_t rows) const {
+        const PerfCounters &counters = local();
+        if (!counters.available()) {
+            fprintf(stderr,
+                    "Counters: perf_event_open failed (%s), see "
+                    "/proc/sys/kernel/perf_event_paranoid\n",
+                    strerror(counters.error()));
+            return;
+        }
+        if (!counters.available(PerfEvent::Cycles))
+            fprintf(stderr,
+                    "Counters: no hardware events (%s), software only\n",
+                    strerror(counters.error()));
+
+        constexpr PerfEvent PER_ROW[] = {
+            PerfEvent::BranchMisses, PerfEvent::L1dMisses,
+            PerfEvent::LlcMisses, PerfEvent::DtlbMisses};
+        fprintf(stderr, "%-8s %14s %14s %6s", "stage", "cycles",
+                "instructions", "IPC");
+        for (const PerfEvent event : PER_ROW)
+            fprintf(stderr, " %14s/row", perfEventName(event));
+        fprintf(stderr, " %12s\n", "page-faults");
+
+        const auto print = [&](PerfEvent event, const PerfSample &sample,
+                               int width, int precision, double divisor) {
+            if (counters.available(event))
+                fprintf(stderr, " %*.*f", width, precision,
+                        sample[event] / divisor);
+            else
+                fprintf(stderr, " %*s", width, "-");
+        };
+        std::lock_guard lk(mtx);
+        for (size_t i = 0; i < STAGES; ++i) {
+            if (scopes[i] == 0)
+                continue;
+            const PerfSample &sample = sums[i];
+            fprintf(stderr, "%-8s", stageName(Stage(i)));
+            print(PerfEvent::Cycles, sample, 14, 0, 1);
+            print(PerfEvent::Instructions, sample, 14, 0, 1);
+            if (counters.available(PerfEvent::Cycles) &&
+                counters.available(PerfEvent::Instructions) &&
+                sample[PerfEvent::Cycles] > 0)
+                fprintf(stderr, " %6.2f",
+                        double(sample[PerfEvent::Instructions]) /
+                            sample[PerfEvent::Cycles]);
+            else
+                fprintf(stderr, " %6s", "-");
+            for (const PerfEvent event : PER_ROW)
+                print(event, sample, 18, 4, rows ? double(rows) : 1.0);
+            print(PerfEvent::PageFaults, sample, 12, 0, 1);
+            fprintf(stderr, "\n");
+        }
+    }
+
+  private:
+    bool enabled = false;
+    mutable std::mutex mtx;
+    std::array<PerfSample, STAGES> sums;
+    std::array<uint64_t, STAGES> scopes = {};
+};
+
+inline StageCounters &stageCounters() {
+    static StageCounters instance;
+    return instance;
+}
+
+/* \brief attribute what the calling thread counts until stop() to stage */
+class StageScope {
+  public:
+    explicit StageScope(Stage stage)
+        : stage(stage), active(stageCounters().isEnabled()) {
+        if (active)
+            start = StageCounters::local().read();
+    }
+
+    ~StageScope() { stop(); }
+
+    StageScope(const StageScope &) = delete;
+    StageScope &operator=(const StageScope &) = delete;
+
+    void stop() {
+        if (!active)
+            return;
+        active = false;
+        stageCounters().add(stage, StageCounters::local().read() - start);
+    }
+
+  private:
+    Stage stage;
+    bool active;
+    PerfSample start;
+};
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "mmap_file.hpp"
+#include "ring_queue.hpp"
+
+/*
+ * \brief background thread that faults in the pages of a mapping up to
+ * distance bytes ahead of the slowest worker, so page-table setup happens
+ * off the workers' critical path
+ *
+ * Workers report the start of every chunk they take with advance() and call
+ * retire() when they run out of work. Pages behind the slowest worker are
+ * never touched again; pages further than distance ahead are left alone so
+ * a slow consumer does not make the prefetcher evict what it just loaded.
+ */
+class Prefetcher {
+  public:
+    /* granularity of one populate call */
+    static constexpr size_t STEP = 2 * 1024 * 1024;
+
+    Prefetcher(const MMapFile &file, uint32_t n_workers, size_t distance)
+        : begin(file.begin()), length(file.size()), distance(distance),
+          positions(n_workers), thread([this] { run(); }) {}
+
+    ~Prefetcher() {
+        stop.store(true, std::memory_order_relaxed);
+        thread.join();
+    }
+
+    Prefetcher(const Prefetcher &) = delete;
+    Prefetcher &operator=(const Prefetcher &) = delete;
+
+    void advance(uint32_t worker, const char *p) {
+        positions[worker].offset.store(size_t(p - begin),
+                                       std::memory_order_relaxed);
+    }
+
+    void retire(uint32_t worker) {
+        positions[worker].offset.store(RETIRED, std::memory_order_relaxed);
+    }
+
+    /* \brief bytes populated by the prefetch thread */
+    size_t prefetched() const {
+        return populated.load(std::memory_order_relaxed);
+    }
+
+  private:
+    static constexpr size_t RETIRED = SIZE_MAX;
+
+    struct alignas(CACHE_LINE) Position {
+        std::atomic<size_t> offset{0};
+    };
+
+    void run() {
+        const size_t page = sysconf(_SC_PAGESIZE);
+        size_t done = 0;
+        while (done < length && !stop.load(std::memory_order_relaxed)) {
+            size_t slowest = RETIRED;
+            for (const Position &position : positions) {
+                const size_t offset =
+                    position.offset.load(std::memory_order_relaxed);
+                slowest = offset < slowest ? offset : slowest;
+            }
+            if (slowest == RETIRED)
+                return;
+            if (done < slowest)
+                done = slowest / page * page;
+
+            const size_t target =
+                length - slowest < distance ? length : slowest + distance;
+            if (done >= target) {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+                continue;
+            }
+            const size_t n = target - done < STEP ? target - done : STEP;
+            populate(begin + done, n, page);
+            done += n;
+            populated.fetch_add(n, std::memory_order_relaxed);
+        }
+    }
+
+    static void populate(const char *p, size_t n, size_t page) {
+#ifdef MADV_POPULATE_READ
+        if (madvise(const_cast<char *>(p), n, MADV_POPULATE_READ) == 0)
+            return;
+#endif
+        /* older kernels: one read per page takes the fault here */
+        for (size_t off = 0; off < n; off += page)
+            static_cast<void>(*static_cast<const volatile char *>(p + off));
+    }
+
+    const char *begin;
+    const size_t length;
+    const size_t distance;
+    std::vector<Position> positions;
+    std::atomic<bool> stop{false};
+    std::atomic<size_t> populated{0};
+    std::thread thread;
+};
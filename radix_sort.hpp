@@ -0,0 +1,104 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <string.h>
+#include <string_view>
+#include <vector>
+
+/*
+ * Byte-wise MSD radix sort of (name, value) entries by name, giving plain
+ * lexicographic byte order: UTF-8 code point order, with a proper prefix
+ * ordered before its extensions ("Abc" < "Abcd").
+ *
+ * Each pass distributes a range on the byte at `depth` into 257 buckets
+ * (bucket 0 for names that end before depth) through a scratch buffer and
+ * recurses into the buckets; small ranges fall back to std::sort on the
+ * remaining suffixes. Large inputs distribute the first byte once and then
+ * sort groups of top-level buckets on separate threads.
+ */
+namespace detail {
+
+constexpr size_t RADIX_SMALL = 32;
+constexpr size_t RADIX_PARALLEL_MIN = 64 * 1024;
+constexpr size_t RADIX_BUCKETS = 257;
+
+inline size_t bucketOf(std::string_view name, size_t depth) {
+    return depth < name.size() ? 1 + uint8_t(name[depth]) : 0;
+}
+
+/*
+ * \brief distribute [begin, end) by the byte at depth; fills
+ * offsets[0..RADIX_BUCKETS] with bucket boundaries relative to begin
+ */
+template <typename T>
+void radixPass(T *begin, T *end, T *scratch, size_t depth,
+               size_t (&offsets)[RADIX_BUCKETS + 1]) {
+    size_t count[RADIX_BUCKETS] = {};
+    for (T *p = begin; p < end; ++p)
+        ++count[bucketOf(p->first, depth)];
+
+    offsets[0] = 0;
+    for (size_t b = 0; b < RADIX_BUCKETS; ++b)
+        offsets[b + 1] = offsets[b] + count[b];
+
+    size_t next[RADIX_BUCKETS];
+    std::copy(offsets, offsets + RADIX_BUCKETS, next);
+    for (T *p = begin; p < end; ++p)
+        scratch[next[bucketOf(p->first, depth)]++] = std::move(*p);
+    std::move(scratch, scratch + (end - begin), begin);
+}
+
+template <typename T>
+void msdRadixSort(T *begin, T *end, T *scratch, size_t depth) {
+    if (size_t(end - begin) < RADIX_SMALL) {
+        std::sort(begin, end, [depth](const T &a, const T &b) {
+            return a.first.substr(depth) < b.first.substr(depth);
+        });
+        return;
+    }
+
+    size_t offsets[RADIX_BUCKETS + 1];
+    radixPass(begin, end, scratch, depth, offsets);
+    /* bucket 0 holds names equal up to their end: nothing left to order */
+    for (size_t b = 1; b < RADIX_BUCKETS; ++b)
+        if (offsets[b + 1] - offsets[b] > 1)
+            msdRadixSort(begin + offsets[b], begin + offsets[b + 1],
+                         scratch + offsets[b], depth + 1);
+}
+
+} // namespace detail
+
+template <typename T>
+void sortByName(std::vector<T> &entries, uint32_t n_threads = 1) {
+    using namespace detail;
+    std::vector<T> scratch(entries.size());
+    T *begin = entries.data(), *end = begin + entries.size();
+    if (entries.size() < RADIX_PARALLEL_MIN || n_threads <= 1) {
+        msdRadixSort(begin, end, scratch.data(), 0);
+        return;
+    }
+
+    size_t offsets[RADIX_BUCKETS + 1];
+    radixPass(begin, end, scratch.data(), 0, offsets);
+
+    /* contiguous groups of top-level buckets of roughly equal size */
+    std::vector<std::future<void>> tasks;
+    const size_t share = entries.size() / n_threads + 1;
+    for (size_t first = 1; first < RADIX_BUCKETS;) {
+        size_t last = first + 1;
+        while (last < RADIX_BUCKETS &&
+               offsets[last + 1] - offsets[first] <= share)
+            ++last;
+        tasks.push_back(std::async(std::launch::async, [&, first, last] {
+            for (size_t b = first; b < last; ++b)
+                msdRadixSort(begin + offsets[b], begin + offsets[b + 1],
+                             scratch.data() + offsets[b], 1);
+        }));
+        first = last;
+    }
+    for (auto &task : tasks)
+        task.get();
+}
@@ -0,0 +1,272 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "io_util.hpp"
+#include "shared_queue.hpp"
+
+/*
+ * Asynchronous positional reads for the streaming backends. A caller
+ * submits up to depth() reads, each tagged with a slot in [0, depth()),
+ * and waits for them by slot in whatever order it needs. Reads are
+ * complete: an engine only returns fewer bytes than requested at the end
+ * of the file.
+ */
+class ReadEngine {
+  public:
+    virtual ~ReadEngine() = default;
+
+    virtual uint32_t depth() const = 0;
+    virtual void submit(uint32_t slot, int fd, char *buf, size_t len,
+                        uint64_t offset) = 0;
+    /* \brief bytes read into the slot's buffer */
+    virtual size_t wait(uint32_t slot) = 0;
+};
+
+/*
+ * \brief fallback engine: a pool of depth() threads, each running blocking
+ * preads taken from a request queue
+ */
+class PreadEngine : public ReadEngine {
+  public:
+    explicit PreadEngine(uint32_t depth) : slots(depth) {
+        for (uint32_t i = 0; i < depth; ++i)
+            threads.emplace_back([this] { serve(); });
+    }
+
+    ~PreadEngine() override {
+        requests.close();
+        for (std::thread &thread : threads)
+            thread.join();
+    }
+
+    uint32_t depth() const override { return slots.size(); }
+
+    void submit(uint32_t slot, int fd, char *buf, size_t len,
+                uint64_t offset) override {
+        slots[slot].result.store(PENDING, std::memory_order_relaxed);
+        requests.push({slot, fd, buf, len, offset});
+    }
+
+    size_t wait(uint32_t slot) override {
+        std::atomic<int64_t> &result = slots[slot].result;
+        int64_t n;
+        while ((n = result.load(std::memory_order_acquire)) == PENDING)
+            result.wait(PENDING);
+        return size_t(n);
+    }
+
+  private:
+    static constexpr int64_t PENDING = -1;
+
+    struct Request {
+        uint32_t slot;
+        int fd;
+        char *buf;
+        size_t len;
+        uint64_t offset;
+    };
+
+    struct alignas(64) Slot {
+        std::atomic<int64_t> result{PENDING};
+    };
+
+    void serve() {
+        while (const std::optional<Request> req = requests.pop()) {
+            const size_t n =
+                preadFull(req->fd, req->buf, req->len, req->offset);
+            std::atomic<int64_t> &result = slots[req->slot].result;
+            result.store(int64_t(n), std::memory_order_release);
+            result.notify_one();
+        }
+    }
+
+    std::vector<Slot> slots;
+    SharedQueue<Request> requests;
+    std::vector<std::thread> threads;
+};
+
+/*
+ * \brief io_uring engine on raw syscalls (no liburing dependency): one
+ * IORING_OP_READ per submit, completions reaped into per-slot results
+ */
+class UringEngine : public ReadEngine {
+  public:
+    /* \brief returns nullptr when io_uring is unavailable or disabled */
+    static std::unique_ptr<UringEngine> create(uint32_t depth) {
+        std::unique_ptr<UringEngine> engine(new UringEngine(depth));
+        if (!engine->setup())
+            return nullptr;
+        return engine;
+    }
+
+    ~UringEngine() override {
+        if (sq_ring != MAP_FAILED)
+            munmap(sq_ring, sq_ring_size);
+        if (cq_ring != MAP_FAILED && cq_ring != sq_ring)
+            munmap(cq_ring, cq_ring_size);
+        if (sqes != MAP_FAILED)
+            munmap(sqes, sqes_size);
+        if (ring_fd != -1)
+            close(ring_fd);
+    }
+
+    uint32_t depth() const override { return results.size(); }
+
+    void submit(uint32_t slot, int fd, char *buf, size_t len,
+                uint64_t offset) override {
+        results[slot] = {fd, buf, len, offset, PENDING};
+        push(slot, fd, buf, len, offset);
+    }
+
+    size_t wait(uint32_t slot) override {
+        while (results[slot].res == PENDING)
+            reap();
+        Result &result = results[slot];
+        if (result.res < 0) {
+            errno = int(-result.res);
+            perror("io_uring read");
+            exit(1);
+        }
+        /* a short read before EOF: finish it synchronously */
+        size_t n = size_t(result.res);
+        if (n > 0 && n < result.len)
+            n += preadFull(result.fd, result.buf + n, result.len - n,
+                           result.offset + n);
+        return n;
+    }
+
+  private:
+    static constexpr int64_t PENDING = INT64_MIN;
+
+    struct Result {
+        int fd;
+        char *buf;
+        size_t len;
+        uint64_t offset;
+        int64_t res;
+    };
+
+    explicit UringEngine(uint32_t depth) : results(depth) {}
+
+    bool setup() {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        ring_fd = int(syscall(__NR_io_uring_setup, depth(), &params));
+        if (ring_fd < 0)
+            return false;
+
+        sq_ring_size =
+            params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+        cq_ring_size =
+            params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap)
+            sq_ring_size = cq_ring_size =
+                sq_ring_size > cq_ring_size ? sq_ring_size : cq_ring_size;
+
+        sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+        if (sq_ring == MAP_FAILED)
+            return false;
+        cq_ring = single_mmap
+                      ? sq_ring
+                      : mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, ring_fd,
+                             IORING_OFF_CQ_RING);
+        if (cq_ring == MAP_FAILED)
+            return false;
+        sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED)
+            return false;
+
+        char *sq = static_cast<char *>(sq_ring);
+        sq_tail = reinterpret_cast<uint32_t *>(sq + params.sq_off.tail);
+        sq_mask = *reinterpret_cast<uint32_t *>(sq + params.sq_off.ring_mask);
+        sq_array = reinterpret_cast<uint32_t *>(sq + params.sq_off.array);
+        char *cq = static_cast<char *>(cq_ring);
+        cq_head = reinterpret_cast<uint32_t *>(cq + params.cq_off.head);
+        cq_tail = reinterpret_cast<uint32_t *>(cq + params.cq_off.tail);
+        cq_mask = *reinterpret_cast<uint32_t *>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    void push(uint32_t slot, int fd, char *buf, size_t len, uint64_t offset) {
+        const uint32_t tail = __atomic_load_n(sq_tail, __ATOMIC_RELAXED);
+        const uint32_t index = tail & sq_mask;
+        io_uring_sqe &sqe = static_cast<io_uring_sqe *>(sqes)[index];
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READ;
+        sqe.fd = fd;
+        sqe.addr = reinterpret_cast<uint64_t>(buf);
+        sqe.len = uint32_t(len);
+        sqe.off = offset;
+        sqe.user_data = slot;
+        sq_array[index] = index;
+        __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+        while (syscall(__NR_io_uring_enter, ring_fd, 1, 0, 0, nullptr, 0) <
+               0) {
+            if (errno != EINTR && errno != EAGAIN) {
+                perror("io_uring_enter");
+                exit(1);
+            }
+        }
+    }
+
+    /* \brief block for at least one completion and record all available */
+    void reap() {
+        uint32_t head = __atomic_load_n(cq_head, __ATOMIC_RELAXED);
+        while (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+            if (syscall(__NR_io_uring_enter, ring_fd, 0, 1,
+                        IORING_ENTER_GETEVENTS, nullptr, 0) < 0 &&
+                errno != EINTR) {
+                perror("io_uring_enter");
+                exit(1);
+            }
+        }
+        for (; head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE); ++head) {
+            const io_uring_cqe &cqe = cqes[head & cq_mask];
+            results[cqe.user_data].res = cqe.res;
+        }
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    int ring_fd = -1;
+    std::vector<Result> results;
+
+    void *sq_ring = MAP_FAILED, *cq_ring = MAP_FAILED, *sqes = MAP_FAILED;
+    size_t sq_ring_size = 0, cq_ring_size = 0, sqes_size = 0;
+    uint32_t *sq_tail = nullptr, *sq_array = nullptr;
+    uint32_t *cq_head = nullptr, *cq_tail = nullptr;
+    uint32_t sq_mask = 0, cq_mask = 0;
+    io_uring_cqe *cqes = nullptr;
+};
+
+/* \brief io_uring when requested and available, else the pread pool */
+inline std::unique_ptr<ReadEngine> makeReadEngine(uint32_t depth,
+                                                  bool prefer_uring) {
+    if (prefer_uring) {
+        if (std::unique_ptr<UringEngine> engine = UringEngine::create(depth))
+            return engine;
+        fprintf(stderr, "io_uring unavailable, falling back to pread\n");
+    }
+    return std::make_unique<PreadEngine>(depth);
+}
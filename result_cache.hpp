@@ -0,0 +1,152 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <fcntl.h>
+#include <optional>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "io_util.hpp"
+#include "partial_file.hpp"
+#include "result_merger.hpp"
+
+/*
+ * Final aggregates kept on disk across runs. An entry is keyed by the
+ * identity of every input (device, inode, size, mtime) plus a fingerprint of
+ * SAMPLES blocks spread over its content, which catches files rewritten in
+ * place with a restored mtime, and by the byte range and station selection
+ * of the run. The entry file is named after a hash of the key and stores
+ * the full key in front of a partial file (see partial_file.hpp), so a hash
+ * collision is a miss.
+ *
+ * Streams have no identity, so a run with any stream input is uncacheable.
+ * The cache is best effort: a failure to write an entry is reported and the
+ * run goes on.
+ */
+class ResultCache {
+  public:
+    static constexpr uint32_t VERSION = 1;
+    static constexpr size_t SAMPLES = 16;
+    static constexpr size_t SAMPLE_SIZE = 4096;
+
+    ResultCache(std::string dir, const std::vector<std::string> &paths,
+                size_t range_begin, size_t range_end,
+                const std::vector<std::string> &stations)
+        : dir(std::move(dir)) {
+        append(VERSION);
+        append(uint64_t(range_begin));
+        append(uint64_t(range_end));
+        /* a run for some stations may skip the others' rows */
+        append(uint64_t(stations.size()));
+        for (const std::string &name : stations) {
+            append(uint32_t(name.size()));
+            key += name;
+        }
+        for (const std::string &path : paths) {
+            if (!addInput(path)) {
+                key.clear();
+                return;
+            }
+        }
+        char name[32];
+        snprintf(name, sizeof(name), "/%016llx.part",
+                 static_cast<unsigned long long>(hash(key)));
+        entry = this->dir + name;
+    }
+
+    bool cacheable() const { return !key.empty(); }
+
+    const std::string &path() const { return entry; }
+
+    /* \brief the cached aggregate, if there is an entry for this key */
+    std::optional<std::vector<PartialResult>> load() const {
+        if (!cacheable())
+            return std::nullopt;
+        std::string bytes;
+        if (!readFile(entry, bytes))
+            return std::nullopt;
+
+        const std::string_view view = bytes;
+        if (view.substr(0, key.size()) != key)
+            return std::nullopt;
+        std::vector<PartialResult> result(1);
+        if (!decodePartial(view.substr(key.size()), result[0]))
+            return std::nullopt;
+        return result;
+    }
+
+    /* \brief write the entry for this key, see replaceFile */
+    void store(const std::vector<PartialResult> &result) const {
+        if (!cacheable())
+            return;
+        if (mkdir(dir.c_str(), 0755) == -1 && errno != EEXIST) {
+            perror(dir.c_str());
+            return;
+        }
+        replaceFile(entry, {key, encodePartial(result)});
+    }
+
+  private:
+    template <typename T> void append(T value) {
+        key.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    bool addInput(const std::string &path) {
+        if (path == "-")
+            return false;
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd == -1)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+            close(fd);
+            return false;
+        }
+        append(uint64_t(st.st_dev));
+        append(uint64_t(st.st_ino));
+        append(uint64_t(st.st_size));
+        append(int64_t(st.st_mtim.tv_sec));
+        append(int64_t(st.st_mtim.tv_nsec));
+        append(fingerprint(fd, st.st_size));
+        close(fd);
+        return true;
+    }
+
+    /* \brief hash of SAMPLES blocks from the start to the end of the file */
+    static uint64_t fingerprint(int fd, size_t size) {
+        std::string samples;
+        char block[SAMPLE_SIZE];
+        const size_t last = size > SAMPLE_SIZE ? size - SAMPLE_SIZE : 0;
+        for (size_t i = 0; i < SAMPLES; ++i) {
+            const size_t n = preadFull(fd, block, SAMPLE_SIZE,
+                                       last * i / (SAMPLES - 1));
+            samples.append(block, n);
+        }
+        return hash(samples);
+    }
+
+    static uint64_t hash(std::string_view bytes) {
+        uint64_t h = bytes.size();
+        for (size_t off = 0; off < bytes.size(); off += 8) {
+            uint64_t word = 0;
+            memcpy(&word, bytes.data() + off,
+                   std::min<size_t>(8, bytes.size() - off));
+            h = (h ^ word) * 0x9E3779B97F4A7C15ull;
+            h ^= h >> 32;
+        }
+        return h;
+    }
+
+    std::string dir;
+    std::string key;
+    std::string entry;
+};
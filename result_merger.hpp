@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "output.hpp"
+#include "perf_counters.hpp"
+#include "radix_sort.hpp"
+#include "station_table.hpp"
+#include "trace.hpp"
+
+using PartialResult = StationTable;
+
+inline void combinePartialResult(PartialResult &lhs, const PartialResult &rhs) {
+    for (const auto &[k, v] : rhs)
+        lhs[k] += v;
+}
+
+/*
+ * Collects worker results without a serial merge on the main thread.
+ *
+ * merge(): a finishing worker takes any result parked by an earlier
+ * finisher, folds the smaller table into the larger and repeats until
+ * nothing is parked, then parks its own. Merges therefore run on the
+ * workers, concurrently, while slower workers are still parsing; with
+ * simultaneous finishers this degenerates into a pairwise tree of
+ * log2(N) rounds. Exactly one result is left once every worker has
+ * submitted.
+ *
+ * keep(): high-cardinality partitions are disjoint and are stored as is.
+ */
+class ResultMerger {
+  public:
+    void merge(PartialResult &&result) {
+        TRACE_SCOPE("merge");
+        /* every round moves a parked table in, so one empty table will do */
+        PartialResult other;
+        while (true) {
+            {
+                std::lock_guard lk(mtx);
+                if (parked.empty()) {
+                    parked.push_back(std::move(result));
+                    return;
+                }
+                other = std::move(parked.back());
+                parked.pop_back();
+            }
+            if (other.size() > result.size())
+                std::swap(other, result);
+            combinePartialResult(result, other);
+        }
+    }
+
+    void keep(PartialResult &&result) {
+        std::lock_guard lk(mtx);
+        parked.push_back(std::move(result));
+    }
+
+    /* \brief results with disjoint key sets; call after all workers are done */
+    std::vector<PartialResult> take() {
+        std::lock_guard lk(mtx);
+        return std::move(parked);
+    }
+
+  private:
+    std::mutex mtx;
+    std::vector<PartialResult> parked;
+};
+
+/* \brief results hold disjoint key sets (merged or partitioned) */
+inline Result getOrderedResult(std::span<const PartialResult> results,
+                               uint32_t n_threads) {
+    TRACE_SCOPE("sort");
+    const StageScope stage(Stage::Sort);
+    size_t total = 0;
+    for (const PartialResult &result : results)
+        total += result.size();
+    Result res;
+    res.reserve(total);
+    for (const PartialResult &result : results)
+        for (const auto &[k, v] : result)
+            res.emplace_back(k, v);
+    sortByName(res, n_threads);
+    return res;
+}
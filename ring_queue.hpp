@@ -0,0 +1,147 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+constexpr size_t CACHE_LINE = 64;
+
+/*
+ * Bounded lock-free single-producer/multi-consumer ring with the same
+ * push/pop/close interface as SharedQueue.
+ *
+ * Every cell carries a sequence number (Vyukov's bounded queue): a cell at
+ * position pos is free for the producer when seq == pos and holds an element
+ * for consumers when seq == pos + 1. Consumers claim positions with a CAS on
+ * tail; only the producer writes head. Cells and both indices sit on
+ * their own cache lines.
+ *
+ * Waiting spins for a while and then parks on an epoch counter with
+ * std::atomic::wait; the other side only issues a notify when someone is
+ * actually parked, so the uncontended path has no syscalls.
+ */
+template <typename T, size_t Capacity = 1024> class RingQueue {
+    static_assert((Capacity & (Capacity - 1)) == 0,
+                  "capacity must be a power of two");
+    static constexpr size_t MASK = Capacity - 1;
+    static constexpr uint32_t SPIN_LIMIT = 256;
+
+  public:
+    RingQueue() {
+        for (size_t i = 0; i < Capacity; ++i)
+            cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    RingQueue(const RingQueue &) = delete;
+    RingQueue &operator=(const RingQueue &) = delete;
+
+    RingQueue(RingQueue &&) = delete;
+    RingQueue &operator=(RingQueue &&) = delete;
+
+    void push(T val) {
+        const size_t pos = head.load(std::memory_order_relaxed);
+        Cell &cell = cells[pos & MASK];
+        uint32_t spins = 0;
+        while (cell.seq.load(std::memory_order_acquire) != pos)
+            idle(popped, spins, [&] {
+                return cell.seq.load(std::memory_order_acquire) == pos;
+            });
+        cell.val = val;
+        cell.seq.store(pos + 1, std::memory_order_release);
+        head.store(pos + 1, std::memory_order_relaxed);
+        wake(pushed, false);
+    }
+
+    /* \brief blocks until an element is available; empty once closed and
+     * drained */
+    std::optional<T> pop() {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        uint32_t spins = 0;
+        while (true) {
+            Cell &cell = cells[pos & MASK];
+            const intptr_t dif =
+                intptr_t(cell.seq.load(std::memory_order_acquire)) -
+                intptr_t(pos + 1);
+            if (dif == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed)) {
+                    T val = cell.val;
+                    cell.seq.store(pos + Capacity, std::memory_order_release);
+                    wake(popped, false);
+                    return val;
+                }
+            } else if (dif < 0) {
+                if (closed.load(std::memory_order_acquire) &&
+                    intptr_t(cell.seq.load(std::memory_order_acquire)) -
+                            intptr_t(pos + 1) <
+                        0)
+                    return std::nullopt;
+                idle(pushed, spins, [&] {
+                    return cell.seq.load(std::memory_order_acquire) != pos ||
+                           closed.load(std::memory_order_acquire);
+                });
+                pos = tail.load(std::memory_order_relaxed);
+            } else {
+                pos = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /* \brief no more pushes; wakes every parked consumer */
+    void close() {
+        closed.store(true, std::memory_order_release);
+        wake(pushed, true);
+    }
+
+    /* \brief approximate when called concurrently with push/pop */
+    size_t size() const {
+        const size_t t = tail.load(std::memory_order_relaxed);
+        const size_t h = head.load(std::memory_order_relaxed);
+        return h > t ? h - t : 0;
+    }
+
+    bool empty() const { return size() == 0; }
+
+  private:
+    struct alignas(CACHE_LINE) Cell {
+        std::atomic<size_t> seq;
+        T val;
+    };
+
+    struct alignas(CACHE_LINE) Event {
+        std::atomic<uint32_t> epoch{0};
+        std::atomic<uint32_t> sleepers{0};
+    };
+
+    template <typename Ready>
+    static void idle(Event &event, uint32_t &spins, Ready &&ready) {
+        if (spins < SPIN_LIMIT) {
+            ++spins;
+            __builtin_ia32_pause();
+            return;
+        }
+        const uint32_t epoch = event.epoch.load();
+        event.sleepers.fetch_add(1);
+        if (!ready())
+            event.epoch.wait(epoch);
+        event.sleepers.fetch_sub(1);
+    }
+
+    static void wake(Event &event, bool all) {
+        event.epoch.fetch_add(1);
+        if (event.sleepers.load() == 0)
+            return;
+        if (all)
+            event.epoch.notify_all();
+        else
+            event.epoch.notify_one();
+    }
+
+    Cell cells[Capacity];
+    alignas(CACHE_LINE) std::atomic<size_t> tail{0};
+    alignas(CACHE_LINE) std::atomic<size_t> head{0};
+    std::atomic<bool> closed{false};
+    Event pushed;
+    Event popped;
+};
@@ -0,0 +1,388 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <limits.h>
+#include <map>
+#include <optional>
+#include <stdio.h>
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <thread>
+#include <tuple>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "parse_size.hpp"
+
+/*
+ * scale: run the full 1brc pipeline over a matrix of thread counts, chunk
+ * sizes, queue kinds and I/O backends, each configuration with warm and/or
+ * cold page cache and several repetitions, and report throughput, speedup
+ * and efficiency over the fewest threads, and run-to-run variation as CSV
+ * or JSON.
+ *
+ * Every run is a fresh 1brc process with its output discarded and is timed
+ * from fork to exit. A warm configuration gets one unmeasured run first; a
+ * cold run drops the inputs from the page cache with POSIX_FADV_DONTNEED
+ * before it starts, which only works for pages nobody else holds dirty or
+ * mapped. The chunk size is --chunk-size for the mmap backend and
+ * --io-block for the streaming ones; the queue only applies to mmap.
+ *
+ * A configuration that 1brc rejects or fails on (a chunk size past its
+ * limit, say) is reported and left out, and the sweep goes on; scale then
+ * exits with status 1 after writing the results of the others.
+ */
+
+struct ScaleOptions {
+    std::string binary;
+    std::vector<std::string> inputs;
+    std::vector<uint32_t> threads;
+    std::vector<size_t> chunk_sizes = {128 * 1024};
+    std::vector<std::string> queues = {"static"};
+    std::vector<std::string> ios = {"mmap"};
+    std::vector<std::string> caches = {"warm"};
+    uint32_t repetitions = 5;
+    bool json = false;
+    std::string output;
+};
+
+struct Measurement {
+    std::string io, queue, cache;
+    size_t chunk_size;
+    uint32_t threads;
+    std::vector<double> ms;
+
+    double mean() const {
+        double sum = 0;
+        for (const double t : ms)
+            sum += t;
+        return sum / ms.size();
+    }
+
+    /* \brief sample standard deviation */
+    double stddev() const {
+        if (ms.size() < 2)
+            return 0;
+        const double m = mean();
+        double sum = 0;
+        for (const double t : ms)
+            sum += (t - m) * (t - m);
+        return std::sqrt(sum / (ms.size() - 1));
+    }
+
+    double min() const { return *std::min_element(ms.begin(), ms.end()); }
+};
+
+void printScaleUsage(const char *prog) {
+    std::cerr << "Usage " << prog
+              << " [--binary PATH] [--threads N,...] [--chunk-size SIZE,...]"
+                 " [--queue static|mutex|ring,...] [--io mmap|uring|pread,...]"
+                 " [--cache warm|cold,...] [--repetitions N]"
+                 " [--format csv|json] [--output FILE] <input_file>...\n";
+}
+
+/* \brief split "a,b,c", parsing every item with parse(item, out) */
+template <typename T, typename F>
+std::optional<std::vector<T>> parseList(std::string_view value, F &&parse) {
+    std::vector<T> items;
+    for (size_t start = 0; start <= value.size();) {
+        const size_t end = std::min(value.find(',', start), value.size());
+        T item;
+        if (!parse(value.substr(start, end - start), item))
+            return std::nullopt;
+        items.push_back(item);
+        start = end + 1;
+    }
+    return items;
+}
+
+/* \brief a list item parser accepting one of choices */
+auto oneOf(std::vector<std::string_view> choices) {
+    return [choices](std::string_view item, std::string &out) {
+        out = item;
+        return std::find(choices.begin(), choices.end(), item) !=
+               choices.end();
+    };
+}
+
+bool parseScaleOptions(int argc, char **argv, ScaleOptions &opts) {
+    const auto count = [](std::string_view item, auto &out) {
+        out = parseCount(item);
+        return out > 0;
+    };
+    const auto bytes = [](std::string_view item, auto &out) {
+        out = parseSize(item);
+        return out > 0;
+    };
+    const auto queue_kinds = oneOf({"static", "mutex", "ring"});
+    const auto backends = oneOf({"mmap", "uring", "pread"});
+    const auto cache_states = oneOf({"warm", "cold"});
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg.size() < 2 || arg.substr(0, 2) != "--") {
+            opts.inputs.emplace_back(arg);
+            continue;
+        }
+
+        std::string_view name = arg.substr(2), value;
+        if (const size_t eq = name.find('='); eq != name.npos) {
+            value = name.substr(eq + 1);
+            name = name.substr(0, eq);
+        } else if (i + 1 < argc) {
+            value = argv[++i];
+        }
+
+        if (name == "binary" && !value.empty()) {
+            opts.binary = value;
+        } else if (name == "threads" && parseList<uint32_t>(value, count)) {
+            opts.threads = *parseList<uint32_t>(value, count);
+        } else if (name == "chunk-size" && parseList<size_t>(value, bytes)) {
+            opts.chunk_sizes = *parseList<size_t>(value, bytes);
+        } else if (name == "queue" &&
+                   parseList<std::string>(value, queue_kinds)) {
+            opts.queues = *parseList<std::string>(value, queue_kinds);
+        } else if (name == "io" && parseList<std::string>(value, backends)) {
+            opts.ios = *parseList<std::string>(value, backends);
+        } else if (name == "cache" &&
+                   parseList<std::string>(value, cache_states)) {
+            opts.caches = *parseList<std::string>(value, cache_states);
+        } else if (name == "repetitions" && parseCount(value) > 0) {
+            opts.repetitions = parseCount(value);
+        } else if (name == "format" && value == "csv") {
+            opts.json = false;
+        } else if (name == "format" && value == "json") {
+            opts.json = true;
+        } else if (name == "output" && !value.empty()) {
+            opts.output = value;
+        } else {
+            std::cerr << "Unknown option: " << arg << "\n";
+            printScaleUsage(argv[0]);
+            return false;
+        }
+    }
+
+    if (opts.inputs.empty()) {
+        printScaleUsage(argv[0]);
+        return false;
+    }
+    if (opts.binary.empty()) {
+        /* the 1brc built next to this executable */
+        char self[PATH_MAX];
+        const ssize_t n = readlink("/proc/self/exe", self, sizeof(self) - 1);
+        const std::string_view path(self, n > 0 ? n : 0);
+        opts.binary = std::string(path.substr(0, path.rfind('/') + 1)) + "1brc";
+    }
+    if (opts.threads.empty()) {
+        const uint32_t hw = std::max(std::thread::hardware_concurrency(), 1u);
+        for (uint32_t n = 1; n < hw; n *= 2)
+            opts.threads.push_back(n);
+        opts.threads.push_back(hw);
+    }
+    return true;
+}
+
+/* \brief evict the inputs from the page cache */
+void dropCache(const std::vector<std::string> &inputs) {
+    for (const std::string &input : inputs) {
+        const int fd = open(input.c_str(), O_RDONLY);
+        if (fd == -1 || posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) != 0) {
+            perror(input.c_str());
+            exit(1);
+        }
+        close(fd);
+    }
+}
+
+/* \brief wall time of one run of args in ms; nullopt if the run fails */
+std::optional<double> run(const std::vector<std::string> &args) {
+    std::vector<char *> argv;
+    for (const std::string &arg : args)
+        argv.push_back(const_cast<char *>(arg.c_str()));
+    argv.push_back(nullptr);
+
+    const auto start = std::chrono::steady_clock::now();
+    const pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        exit(1);
+    }
+    if (pid == 0) {
+        const int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+    int status;
+    if (waitpid(pid, &status, 0) == -1) {
+        perror("waitpid");
+        exit(1);
+    }
+    const auto end = std::chrono::steady_clock::now();
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        std::cerr << "Run failed:";
+        for (const std::string &arg : args)
+            std::cerr << " " << arg;
+        std::cerr << "\n";
+        return std::nullopt;
+    }
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+/* \brief the 1brc command line of configuration m */
+std::vector<std::string> commandLine(const ScaleOptions &opts,
+                                     const Measurement &m) {
+    std::vector<std::string> args = {opts.binary, "--io", m.io};
+    if (m.io == "mmap") {
+        args.insert(args.end(), {"--chunk-size", std::to_string(m.chunk_size)});
+        if (m.queue == "static")
+            args.insert(args.end(), {"--mode", "static"});
+        else
+            args.insert(args.end(), {"--mode", "queue", "--queue", m.queue});
+    } else {
+        args.insert(args.end(), {"--io-block", std::to_string(m.chunk_size)});
+    }
+    args.insert(args.end(), opts.inputs.begin(), opts.inputs.end());
+    args.push_back(std::to_string(m.threads));
+    return args;
+}
+
+void report(std::ostream &out, const ScaleOptions &opts,
+            const std::vector<Measurement> &results, uint64_t input_bytes) {
+    /*
+     * speedup is over the fewest threads of otherwise equal configurations
+     * that ran: {threads, mean ms}
+     */
+    std::map<std::tuple<std::string, std::string, size_t, std::string>,
+             std::pair<uint32_t, double>>
+        base;
+    for (const Measurement &m : results) {
+        const auto [it, inserted] = base.try_emplace(
+            {m.io, m.queue, m.chunk_size, m.cache}, m.threads, m.mean());
+        if (!inserted && m.threads < it->second.first)
+            it->second = {m.threads, m.mean()};
+    }
+
+    if (opts.json)
+        out << "{\"input_bytes\": " << input_bytes << ", \"results\": [";
+    else
+        out << "io,queue,chunk_size,cache,threads,repetitions,mean_ms,"
+               "stddev_ms,min_ms,cv,throughput_mb_s,speedup,efficiency\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Measurement &m = results[i];
+        const double mean = m.mean();
+        const auto [base_threads, base_ms] =
+            base[{m.io, m.queue, m.chunk_size, m.cache}];
+        const double speedup = base_ms / mean;
+        const double efficiency = speedup * base_threads / m.threads;
+        const double throughput = input_bytes / 1e6 / (mean / 1e3);
+        const double cv = m.stddev() / mean;
+        if (opts.json) {
+            out << (i ? ",\n  " : "\n  ") << "{\"io\": \"" << m.io
+                << "\", \"queue\": \"" << m.queue
+                << "\", \"chunk_size\": " << m.chunk_size
+                << ", \"cache\": \"" << m.cache
+                << "\", \"threads\": " << m.threads
+                << ", \"repetitions\": " << m.ms.size() << ", \"ms\": [";
+            for (size_t r = 0; r < m.ms.size(); ++r)
+                out << (r ? ", " : "") << m.ms[r];
+            out << "], \"mean_ms\": " << mean
+                << ", \"stddev_ms\": " << m.stddev()
+                << ", \"min_ms\": " << m.min() << ", \"cv\": " << cv
+                << ", \"throughput_mb_s\": " << throughput
+                << ", \"speedup\": " << speedup
+                << ", \"efficiency\": " << efficiency << "}";
+        } else {
+            out << m.io << "," << m.queue << "," << m.chunk_size << ","
+                << m.cache << "," << m.threads << "," << m.ms.size() << ","
+                << mean << "," << m.stddev() << "," << m.min() << "," << cv
+                << "," << throughput << "," << speedup << "," << efficiency
+                << "\n";
+        }
+    }
+    if (opts.json)
+        out << "\n]}\n";
+}
+
+int main(int argc, char **argv) {
+    ScaleOptions opts;
+    if (!parseScaleOptions(argc, argv, opts))
+        return 1;
+    if (access(opts.binary.c_str(), X_OK) != 0) {
+        perror(opts.binary.c_str());
+        return 1;
+    }
+    uint64_t input_bytes = 0;
+    for (const std::string &input : opts.inputs) {
+        struct stat st;
+        if (stat(input.c_str(), &st) == -1) {
+            perror(input.c_str());
+            return 1;
+        }
+        input_bytes += st.st_size;
+    }
+
+    std::vector<Measurement> results;
+    for (const std::string &io : opts.ios) {
+        /* the streaming backends have no queue to choose */
+        const std::vector<std::string> queues =
+            io == "mmap" ? opts.queues : std::vector<std::string>{"-"};
+        for (const std::string &queue : queues)
+            for (const size_t chunk_size : opts.chunk_sizes)
+                for (const std::string &cache : opts.caches)
+                    for (const uint32_t threads : opts.threads)
+                        results.push_back(
+                            {io, queue, cache, chunk_size, threads, {}});
+    }
+
+    size_t failed = 0;
+    for (size_t i = 0; i < results.size(); ++i) {
+        Measurement &m = results[i];
+        const std::vector<std::string> args = commandLine(opts, m);
+        const bool cold = m.cache == "cold";
+        bool ok = cold || run(args);
+        for (uint32_t r = 0; ok && r < opts.repetitions; ++r) {
+            if (cold)
+                dropCache(opts.inputs);
+            const std::optional<double> ms = run(args);
+            if (ms)
+                m.ms.push_back(*ms);
+            ok = ms.has_value();
+        }
+        if (!ok) {
+            fprintf(stderr,
+                    "[%zu/%zu] io=%s queue=%s chunk=%zu cache=%s "
+                    "threads=%u: skipped\n",
+                    i + 1, results.size(), m.io.c_str(), m.queue.c_str(),
+                    m.chunk_size, m.cache.c_str(), m.threads);
+            m.ms.clear();
+            ++failed;
+            continue;
+        }
+        fprintf(stderr,
+                "[%zu/%zu] io=%s queue=%s chunk=%zu cache=%s threads=%u: "
+                "%.1fms +- %.1fms\n",
+                i + 1, results.size(), m.io.c_str(), m.queue.c_str(),
+                m.chunk_size, m.cache.c_str(), m.threads, m.mean(),
+                m.stddev());
+    }
+
+    std::erase_if(results, [](const Measurement &m) { return m.ms.empty(); });
+    if (opts.output.empty()) {
+        report(std::cout, opts, results, input_bytes);
+        return failed ? 1 : 0;
+    }
+    std::ofstream out(opts.output);
+    report(out, opts, results, input_bytes);
+    if (!out) {
+        perror(opts.output.c_str());
+        return 1;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <immintrin.h>
+#include <string.h>
+
+/*
+ * Row scanners: walk a buffer of "<name>;<value>\n" rows and invoke
+ * onRow(name, name_len, value) for every row terminated inside [begin, end).
+ * All variants return a pointer to the start of the first row that is not
+ * terminated before end (== end if the buffer ends on a row boundary).
+ * Terminated rows without a ';', such as blank lines, are skipped.
+ */
+
+enum class ScanIsa { Scalar, Avx2, Avx512 };
+
+inline ScanIsa detectScanIsa() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512bw"))
+        return ScanIsa::Avx512;
+    if (__builtin_cpu_supports("avx2"))
+        return ScanIsa::Avx2;
+    return ScanIsa::Scalar;
+}
+
+inline const char *scanIsaName(ScanIsa isa) {
+    switch (isa) {
+    case ScanIsa::Avx512:
+        return "avx512";
+    case ScanIsa::Avx2:
+        return "avx2";
+    default:
+        return "scalar";
+    }
+}
+
+template <typename F>
+const char *scanRowsScalar(const char *begin, const char *end, F &&onRow) {
+    const char *itr = begin;
+    while (itr < end) {
+        const char *nl_ptr =
+            static_cast<const char *>(memchr(itr, '\n', end - itr));
+        if (!nl_ptr)
+            break;
+        /* the value is short: searching back from the newline is cheap */
+        const char *sc_ptr =
+            static_cast<const char *>(memrchr(itr, ';', nl_ptr - itr));
+        if (sc_ptr)
+            onRow(itr, size_t(sc_ptr - itr), sc_ptr + 1);
+        itr = nl_ptr + 1;
+    }
+    return itr;
+}
+
+namespace detail {
+
+/* bytes classified per call into a vectorized delimiter finder */
+constexpr size_t SCAN_WINDOW = 4096;
+
+/*
+ * The vector finders only record delimiter offsets: the row callback (hash
+ * table, parser) stays in code compiled for the baseline ISA, which avoids
+ * SSE/AVX transition stalls and keeps the callback out of target-specific
+ * clones.
+ */
+__attribute__((target("avx2"))) inline size_t
+findDelimitersAvx2(const char *begin, const char *end, uint16_t *out) {
+    constexpr size_t BLOCK = 32;
+    const __m256i semi = _mm256_set1_epi8(';');
+    const __m256i nl = _mm256_set1_epi8('\n');
+    const char *p = begin;
+    size_t n = 0;
+
+    const auto emit = [&](uint32_t mask) {
+        const uint16_t base = uint16_t(p - begin);
+        while (mask) {
+            out[n++] = base + __builtin_ctz(mask);
+            mask &= mask - 1;
+        }
+    };
+
+    for (; p + BLOCK <= end; p += BLOCK) {
+        const __m256i v =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        emit(uint32_t(_mm256_movemask_epi8(_mm256_or_si256(
+            _mm256_cmpeq_epi8(v, semi), _mm256_cmpeq_epi8(v, nl)))));
+    }
+
+    if (p < end) {
+        /* never load past end: the last partial block goes through a copy */
+        alignas(BLOCK) char tail[BLOCK] = {};
+        memcpy(tail, p, end - p);
+        const __m256i v =
+            _mm256_load_si256(reinterpret_cast<const __m256i *>(tail));
+        emit(uint32_t(_mm256_movemask_epi8(_mm256_or_si256(
+                 _mm256_cmpeq_epi8(v, semi), _mm256_cmpeq_epi8(v, nl)))) &
+             ((1u << (end - p)) - 1));
+    }
+    return n;
+}
+
+__attribute__((target("avx512f,avx512bw"))) inline size_t
+findDelimitersAvx512(const char *begin, const char *end, uint16_t *out) {
+    constexpr size_t BLOCK = 64;
+    const __m512i semi = _mm512_set1_epi8(';');
+    const __m512i nl = _mm512_set1_epi8('\n');
+    const char *p = begin;
+    size_t n = 0;
+
+    const auto emit = [&](uint64_t mask) {
+        const uint16_t base = uint16_t(p - begin);
+        while (mask) {
+            out[n++] = base + __builtin_ctzll(mask);
+            mask &= mask - 1;
+        }
+    };
+
+    for (; p + BLOCK <= end; p += BLOCK) {
+        const __m512i v = _mm512_loadu_si512(p);
+        emit(_mm512_cmpeq_epi8_mask(v, semi) | _mm512_cmpeq_epi8_mask(v, nl));
+    }
+
+    if (p < end) {
+        /* masked load: bytes at or after end are never touched */
+        const __mmask64 valid = (1ull << (end - p)) - 1;
+        const __m512i v = _mm512_maskz_loadu_epi8(valid, p);
+        emit((_mm512_cmpeq_epi8_mask(v, semi) |
+              _mm512_cmpeq_epi8_mask(v, nl)) &
+             valid);
+    }
+    return n;
+}
+
+/*
+ * \brief walk delimiter offsets window by window; ';' and '\n' strictly
+ * alternate in well-formed input so the byte under each offset tells them
+ * apart, and a '\n' with no ';' since the last one ends a row to skip
+ */
+template <typename Finder, typename F>
+inline const char *scanRowsVector(Finder find, const char *begin,
+                                  const char *end, F &&onRow) {
+    uint16_t offsets[SCAN_WINDOW];
+    const char *row = begin, *sep = nullptr;
+    for (const char *p = begin; p < end; p += SCAN_WINDOW) {
+        const char *window_end =
+            size_t(end - p) > SCAN_WINDOW ? p + SCAN_WINDOW : end;
+        const size_t n = find(p, window_end, offsets);
+        for (size_t i = 0; i < n; ++i) {
+            const char *d = p + offsets[i];
+            if (*d == ';') {
+                sep = d;
+            } else {
+                if (sep != nullptr)
+                    onRow(row, size_t(sep - row), sep + 1);
+                row = d + 1;
+                sep = nullptr;
+            }
+        }
+    }
+    return row;
+}
+
+} // namespace detail
+
+template <typename F>
+const char *scanRowsAvx2(const char *begin, const char *end, F &&onRow) {
+    return detail::scanRowsVector(detail::findDelimitersAvx2, begin, end,
+                                  onRow);
+}
+
+template <typename F>
+const char *scanRowsAvx512(const char *begin, const char *end, F &&onRow) {
+    return detail::scanRowsVector(detail::findDelimitersAvx512, begin, end,
+                                  onRow);
+}
+
+template <typename F>
+const char *scanRows(ScanIsa isa, const char *begin, const char *end,
+                     F &&onRow) {
+    switch (isa) {
+    case ScanIsa::Avx512:
+        return scanRowsAvx512(begin, end, onRow);
+    case ScanIsa::Avx2:
+        return scanRowsAvx2(begin, end, onRow);
+    default:
+        return scanRowsScalar(begin, end, onRow);
+    }
+}
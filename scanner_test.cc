@@ -0,0 +1,82 @@
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "scanner.hpp"
+
+/*
+ * scanner_test: every scanRows ISA the CPU supports against the rows and
+ * the unterminated tail expected of each input, including malformed lines.
+ */
+
+struct Case {
+    const char *what;
+    std::string input;
+    /* "<name>;<value>" of every row reported, in order */
+    std::vector<std::string> rows;
+    /* bytes left unterminated at the end */
+    std::string tail;
+};
+
+std::vector<Case> cases() {
+    std::vector<Case> all = {
+        {"empty", "", {}, ""},
+        {"rows", "A;1.0\nBc;-2.5\n", {"A;1.0", "Bc;-2.5"}, ""},
+        {"tail", "A;1.0\nB;2", {"A;1.0"}, "B;2"},
+        {"blank line", "A;1.0\n\nB;2.0\n", {"A;1.0", "B;2.0"}, ""},
+        {"trailing blank line", "A;1.0\n\n", {"A;1.0"}, ""},
+        {"leading blank lines", "\n\nA;1.0\n", {"A;1.0"}, ""},
+        {"missing ';'", "A;1.0\nB 2.0\nC;3.0\n", {"A;1.0", "C;3.0"}, ""},
+        {"only missing ';'", "A\nB\n", {}, ""},
+        {"missing ';' in the tail", "A;1.0\nB", {"A;1.0"}, "B"},
+    };
+
+    /* the same faults across the vector scanners' window boundaries */
+    Case windows{"windows", "", {}, ""};
+    for (int i = 0; windows.input.size() < 3 * detail::SCAN_WINDOW; ++i) {
+        const std::string row = "S" + std::to_string(i) + ";" +
+                                std::to_string(i % 100) + ".5";
+        windows.input += row + "\n";
+        windows.rows.push_back(row);
+        if (i % 97 == 0)
+            windows.input += "\n";
+        if (i % 131 == 0)
+            windows.input += "no separator\n";
+    }
+    all.push_back(windows);
+    return all;
+}
+
+int main() {
+    int failures = 0;
+    for (const ScanIsa isa :
+         {ScanIsa::Scalar, ScanIsa::Avx2, ScanIsa::Avx512}) {
+        if (isa > detectScanIsa()) {
+            std::cout << "skip " << scanIsaName(isa) << ": not supported\n";
+            continue;
+        }
+        for (const Case &c : cases()) {
+            /* no padding: the scanners must not read past end */
+            const char *begin = c.input.data();
+            const char *end = begin + c.input.size();
+
+            std::vector<std::string> rows;
+            const char *rest = scanRows(
+                isa, begin, end,
+                [&](const char *name, size_t len, const char *value) {
+                    std::string row(name, len + 1);
+                    row.append(value, strchr(value, '\n'));
+                    rows.push_back(row);
+                });
+
+            if (rows != c.rows || std::string_view(rest, end) != c.tail) {
+                std::cout << "FAIL " << scanIsaName(isa) << ": " << c.what
+                          << "\n";
+                ++failures;
+            }
+        }
+    }
+    return failures ? 1 : 0;
+}
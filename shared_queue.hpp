@@ -2,6 +2,7 @@
 
 #include <queue>
 #include <mutex>
+#include <optional>
 #include <condition_variable>
 
 template<typename T>
@@ -22,14 +23,25 @@ class SharedQueue {
             cv.notify_one();
         }
 
-        T pop() {
+        /* \brief blocks until an element is available; empty once closed
+         * and drained */
+        std::optional<T> pop() {
             std::unique_lock lk(mtx);
-            cv.wait(lk, [this]{ return !q.empty(); });
+            cv.wait(lk, [this]{ return !q.empty() || closed; });
+            if (q.empty())
+                return std::nullopt;
             T val = q.front();
             q.pop();
             return val;
         }
 
+        /* \brief no more pushes; wakes every waiting consumer */
+        void close() {
+            std::lock_guard lk(mtx);
+            closed = true;
+            cv.notify_all();
+        }
+
         size_t size() const {
             std::lock_guard lk(mtx);
             return q.size();
@@ -42,6 +54,7 @@ class SharedQueue {
 
     private:
         std::queue<T> q;
+        bool closed = false;
         mutable std::mutex mtx;
         mutable std::condition_variable cv;
 };
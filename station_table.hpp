@@ -0,0 +1,217 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <emmintrin.h>
+#include <memory>
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "data.hpp"
+#include "trace.hpp"
+
+/*
+ * \brief name key derived from one 16-byte load at the start of the name:
+ * the zero-masked prefix is both the inline compare key and the first two
+ * hash words, so the row path touches the name bytes once.
+ */
+struct NameKey {
+    __m128i prefix;
+    uint64_t hash;
+};
+
+namespace detail {
+
+alignas(32) inline constexpr uint8_t PREFIX_MASK[32] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0,    0,    0,    0,    0,    0,
+    0,    0,    0,    0,    0,    0,    0,    0,    0,    0};
+
+inline uint64_t mix(uint64_t h) {
+    h ^= h >> 32;
+    h *= 0xD6E8FEB86659FD93ull;
+    h ^= h >> 32;
+    return h;
+}
+
+} // namespace detail
+
+/*
+ * \brief requires 16 readable bytes at name (see CHUNK_PADDING); bytes past
+ * len are masked off
+ */
+inline NameKey makeNameKey(const char *name, size_t len) {
+    const size_t n = len < 16 ? len : 16;
+    const __m128i mask = _mm_loadu_si128(
+        reinterpret_cast<const __m128i *>(detail::PREFIX_MASK + 16 - n));
+    const __m128i prefix = _mm_and_si128(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(name)), mask);
+
+    uint64_t h = uint64_t(_mm_cvtsi128_si64(prefix)) ^ len;
+    h = h * 0x9E3779B97F4A7C15ull ^
+        uint64_t(_mm_cvtsi128_si64(_mm_unpackhi_epi64(prefix, prefix)));
+    /* long names: fold the remaining 8-byte words, the last one masked */
+    for (size_t off = 16; off < len; off += 8) {
+        uint64_t word;
+        memcpy(&word, name + off, sizeof(word));
+        if (len - off < 8)
+            word &= (1ull << (8 * (len - off))) - 1;
+        h = (h ^ word) * 0x9E3779B97F4A7C15ull;
+    }
+    return {prefix, detail::mix(h)};
+}
+
+/* \brief makeNameKey for names without readable bytes past their end */
+inline NameKey makeNameKeyUnpadded(std::string_view name) {
+    char buf[128 + 16] = {};
+    if (name.size() <= 128) {
+        memcpy(buf, name.data(), name.size());
+        return makeNameKey(buf, name.size());
+    }
+    std::string padded(name);
+    padded.append(16, '\0');
+    return makeNameKey(padded.data(), name.size());
+}
+
+/*
+ * Open-addressing (linear probing) table from station name to Data, sized
+ * to a power of two and kept at most half full.
+ *
+ * A slot is one cache line: the hash, the first 16 name bytes inline for a
+ * single SSE compare, the length, a pointer to the full name and the Data
+ * aggregate. Names are copied into an arena owned by the table once per new
+ * key, so the table never refers back into the input buffer. For the
+ * EXPECTED_UNIQUE_STATIONS workload the whole table is 64 KB.
+ */
+class StationTable {
+  public:
+    using value_type = std::pair<std::string_view, const Data &>;
+
+    explicit StationTable(size_t expected_keys = 0) {
+        size_t capacity = MIN_CAPACITY;
+        while (capacity < 2 * expected_keys)
+            capacity *= 2;
+        slots.reset(new Slot[capacity]());
+        mask = capacity - 1;
+    }
+
+    StationTable(StationTable &&) = default;
+    StationTable &operator=(StationTable &&) = default;
+
+    /* \brief hot path: the key has been derived while scanning the row */
+    Data &find(const char *name, size_t len, const NameKey &key) {
+        for (size_t i = key.hash & mask;; i = (i + 1) & mask) {
+            TRACE_COUNT(Probes, 1);
+            Slot &slot = slots[i];
+            if (slot.name == nullptr)
+                return insert(i, name, len, key);
+            if (slot.hash == key.hash && slot.len == len &&
+                _mm_movemask_epi8(_mm_cmpeq_epi8(slot.prefix, key.prefix)) ==
+                    0xFFFF &&
+                (len <= 16 ||
+                 memcmp(slot.name + 16, name + 16, len - 16) == 0))
+                return slot.data;
+        }
+    }
+
+    /* \brief lookup for names that are not followed by readable padding */
+    Data &operator[](std::string_view name) {
+        return find(name.data(), name.size(), makeNameKeyUnpadded(name));
+    }
+
+    size_t size() const { return count; }
+    size_t capacity() const { return mask + 1; }
+
+    class iterator {
+      public:
+        iterator(const StationTable *table, size_t i) : table(table), i(i) {
+            skip();
+        }
+        value_type operator*() const {
+            const Slot &slot = table->slots[i];
+            return {std::string_view(slot.name, slot.len), slot.data};
+        }
+        iterator &operator++() {
+            ++i;
+            skip();
+            return *this;
+        }
+        bool operator!=(const iterator &rhs) const { return i != rhs.i; }
+
+      private:
+        void skip() {
+            while (i <= table->mask && table->slots[i].name == nullptr)
+                ++i;
+        }
+        const StationTable *table;
+        size_t i;
+    };
+
+    iterator begin() const { return iterator(this, 0); }
+    iterator end() const { return iterator(this, mask + 1); }
+
+  private:
+    static constexpr size_t MIN_CAPACITY = 16;
+    static constexpr size_t ARENA_BLOCK = 64 * 1024;
+
+    struct alignas(64) Slot {
+        __m128i prefix;
+        uint64_t hash;
+        const char *name;
+        uint32_t len;
+        Data data;
+    };
+
+    Data &insert(size_t i, const char *name, size_t len, const NameKey &key) {
+        if (2 * (count + 1) > mask + 1) {
+            grow();
+            for (i = key.hash & mask; slots[i].name != nullptr;
+                 i = (i + 1) & mask)
+                ;
+        }
+        Slot &slot = slots[i];
+        slot.prefix = key.prefix;
+        slot.hash = key.hash;
+        slot.name = copyName(name, len);
+        slot.len = uint32_t(len);
+        ++count;
+        return slot.data;
+    }
+
+    void grow() {
+        std::unique_ptr<Slot[]> old = std::move(slots);
+        const size_t old_capacity = mask + 1;
+        slots.reset(new Slot[2 * old_capacity]());
+        mask = 2 * old_capacity - 1;
+        for (size_t j = 0; j < old_capacity; ++j) {
+            if (old[j].name == nullptr)
+                continue;
+            size_t i = old[j].hash & mask;
+            while (slots[i].name != nullptr)
+                i = (i + 1) & mask;
+            slots[i] = old[j];
+        }
+    }
+
+    const char *copyName(const char *name, size_t len) {
+        if (arena.empty() || arena_used + len > arena_capacity) {
+            arena_capacity = len > ARENA_BLOCK ? len : ARENA_BLOCK;
+            arena.emplace_back(new char[arena_capacity]);
+            arena_used = 0;
+        }
+        char *dst = arena.back().get() + arena_used;
+        memcpy(dst, name, len);
+        arena_used += len;
+        return dst;
+    }
+
+    std::unique_ptr<Slot[]> slots;
+    size_t mask = 0;
+    size_t count = 0;
+    std::vector<std::unique_ptr<char[]>> arena;
+    size_t arena_used = 0;
+    size_t arena_capacity = 0;
+};
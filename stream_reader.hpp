@@ -0,0 +1,270 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fcntl.h>
+#include <memory>
+#include <optional>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "chunk.hpp"
+#include "decompress.hpp"
+#include "read_engine.hpp"
+#include "ring_queue.hpp"
+#include "shared_queue.hpp"
+
+enum class IoBackend { Mmap, Uring, Pread };
+
+/* \brief inputs that cannot be mapped: "-" (stdin), pipes, sockets, ... */
+inline bool isStream(const char *path) {
+    struct stat st;
+    return strcmp(path, "-") == 0 ||
+           (stat(path, &st) == 0 && !S_ISREG(st.st_mode));
+}
+
+/*
+ * \brief fixed set of read buffers, recycled through a free list
+ *
+ * Buffer layout: [HEADROOM][block][padding]. Reads land page-aligned after
+ * the headroom; the headroom takes the unterminated row carried over from
+ * the previous block, so a chunk is always contiguous; the padding keeps
+ * CHUNK_PADDING readable bytes after the last byte read. acquire() blocks
+ * while every buffer is in flight or held by a consumer, which bounds how
+ * far the reader runs ahead of the workers.
+ */
+class BufferPool {
+  public:
+    static constexpr size_t ALIGN = 4096;
+    /* longest row that can straddle two blocks */
+    static constexpr size_t HEADROOM = 64 * 1024;
+
+    BufferPool(uint32_t count, size_t block)
+        : stride(HEADROOM +
+                 (block + CHUNK_PADDING + ALIGN - 1) / ALIGN * ALIGN),
+          length(stride * count) {
+        void *ptr = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ptr == MAP_FAILED) {
+            perror("mmap");
+            exit(1);
+        }
+        arena = static_cast<char *>(ptr);
+        for (uint32_t i = 0; i < count; ++i)
+            free_list.push(i);
+    }
+
+    ~BufferPool() { munmap(arena, length); }
+
+    BufferPool(const BufferPool &) = delete;
+    BufferPool &operator=(const BufferPool &) = delete;
+
+    /* \brief start of a free buffer's block area, HEADROOM bytes in */
+    char *acquire() { return arena + *free_list.pop() * stride + HEADROOM; }
+
+    /* \brief p is anywhere inside a buffer handed out by acquire() */
+    void release(const char *p) {
+        free_list.push(uint32_t(size_t(p - arena) / stride));
+    }
+
+    bool owns(const char *p) const { return p >= arena && p < arena + length; }
+
+  private:
+    const size_t stride;
+    const size_t length;
+    char *arena = nullptr;
+    SharedQueue<uint32_t> free_list;
+};
+
+/*
+ * Streaming alternative to MMapFile: a regular file is read with large
+ * aligned positional reads, up to depth of them in flight on a ReadEngine;
+ * "-" (stdin), pipes and other streams are read front to back, through a
+ * Decoder when the input is gzip, zstd or lz4 compressed. Every completed
+ * block is published as one row-aligned Chunk. Station tables copy names
+ * into their own arenas, so a buffer can be recycled as soon as its rows are
+ * aggregated and memory stays bounded by the pool.
+ *
+ * run() is the producer. It reads the inputs one after another into the same
+ * queue and completes the blocks of each in order: the partial row at the
+ * end of block i is copied in front of block i + 1, so chunks follow the
+ * usual ownership rules (see chunk.hpp) and never span two inputs. Consumers
+ * pop() chunks like from any queue and must release() each one once its
+ * rows are aggregated.
+ */
+class StreamReader {
+  public:
+    StreamReader(const std::vector<std::string> &paths, IoBackend backend,
+                 uint32_t depth, size_t block, uint32_t n_consumers)
+        : paths(paths), backend(backend), depth(depth),
+          block((block + BufferPool::ALIGN - 1) / BufferPool::ALIGN *
+                BufferPool::ALIGN),
+          pool(2 * depth + n_consumers, this->block) {}
+
+    StreamReader(const StreamReader &) = delete;
+    StreamReader &operator=(const StreamReader &) = delete;
+
+    std::optional<Chunk> pop() { return chunks.pop(); }
+    void release(const Chunk &chunk) { pool.release(chunk.data); }
+
+    /* \brief read every input, publishing chunks; closes the queue */
+    void run() {
+        for (const std::string &path : paths)
+            readInput(path.c_str());
+        chunks.close();
+    }
+
+  private:
+    void readInput(const char *path) {
+        const bool is_stdin = strcmp(path, "-") == 0;
+        const int fd = is_stdin ? STDIN_FILENO : open(path, O_RDONLY);
+        if (fd == -1) {
+            perror("open");
+            exit(1);
+        }
+        struct stat st;
+        if (fstat(fd, &st) == -1) {
+            perror("fstat");
+            exit(1);
+        }
+
+        Compression compression = Compression::None;
+        if (S_ISREG(st.st_mode)) {
+            char magic[MAGIC_LENGTH];
+            const ssize_t n = pread(fd, magic, sizeof(magic), 0);
+            compression = detectCompression(
+                std::string_view(magic, n > 0 ? size_t(n) : 0));
+        }
+        if (S_ISREG(st.st_mode) && compression == Compression::None) {
+            posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+            if (!engine)
+                engine = makeReadEngine(depth, backend == IoBackend::Uring);
+            readPositional(fd, st.st_size);
+        } else {
+            /* pipes, sockets, terminals and compressed files are read front
+             * to back */
+            FdSource input(fd);
+            if (!S_ISREG(st.st_mode))
+                compression = detectCompression(input.peek(MAGIC_LENGTH));
+            if (compression == Compression::None) {
+                readSequential(input);
+            } else {
+                std::unique_ptr<Decoder> decoder =
+                    makeDecoder(compression, input);
+                readSequential(*decoder);
+            }
+        }
+
+        if (!is_stdin && close(fd) == -1) {
+            perror("close");
+            exit(1);
+        }
+    }
+
+    /* \brief regular files: up to depth() block reads in flight */
+    void readPositional(int fd, size_t length) {
+        const size_t n_blocks = (length + block - 1) / block;
+        std::vector<char *> in_flight(depth);
+        size_t submitted = 0;
+
+        const auto submitNext = [&] {
+            if (submitted == n_blocks)
+                return;
+            const uint64_t offset = uint64_t(submitted) * block;
+            char *buf = pool.acquire();
+            in_flight[submitted % depth] = buf;
+            engine->submit(submitted % depth, fd, buf,
+                           length - offset < block ? length - offset : block,
+                           offset);
+            ++submitted;
+        };
+
+        for (uint32_t i = 0; i < depth; ++i)
+            submitNext();
+
+        size_t i = 0;
+        for (; i < n_blocks; ++i) {
+            char *data = in_flight[i % depth];
+            const size_t n = engine->wait(i % depth);
+            const bool last = i + 1 == n_blocks ||
+                              n < block; /* truncated while reading */
+            if (!last)
+                submitNext();
+            complete(data, n, last);
+            if (last)
+                break;
+        }
+
+        /* a file that shrank: retire the reads still in flight */
+        for (++i; i < submitted; ++i) {
+            engine->wait(i % depth);
+            pool.release(in_flight[i % depth]);
+        }
+    }
+
+    /*
+     * \brief streams and decompressed input: fill one block at a time on this
+     * thread, overlapping with the workers aggregating earlier ones; memory
+     * stays at the pool size whatever the input length
+     */
+    void readSequential(ByteSource &source) {
+        while (true) {
+            char *data = pool.acquire();
+            const size_t n = source.read(data, block);
+            complete(data, n, n < block);
+            if (n < block)
+                return;
+        }
+    }
+
+    /*
+     * \brief publish the rows of a filled block with the carried partial row
+     * in front, and carry over its own unterminated tail unless it is last
+     */
+    void complete(char *data, size_t n, bool last) {
+        char *begin = data - carry.size();
+        memcpy(begin, carry.data(), carry.size());
+        char *end = data + n;
+        if (last) {
+            memset(end, 0, CHUNK_PADDING);
+            carry.clear();
+            publish(begin, end);
+            return;
+        }
+
+        const void *nl = memrchr(data, '\n', n);
+        char *cut =
+            nl ? static_cast<char *>(const_cast<void *>(nl)) + 1 : begin;
+        if (size_t(end - cut) > BufferPool::HEADROOM) {
+            fprintf(stderr, "row longer than %zu bytes\n",
+                    BufferPool::HEADROOM);
+            exit(1);
+        }
+        carry.assign(cut, end);
+        publish(begin, cut);
+    }
+
+    void publish(char *begin, char *end) {
+        if (begin == end)
+            pool.release(begin);
+        else
+            chunks.push({begin, size_t(end - begin)});
+    }
+
+    const std::vector<std::string> paths;
+    const IoBackend backend;
+    const uint32_t depth;
+    const size_t block;
+    std::string carry;
+    BufferPool pool;
+    /* created on the first regular file */
+    std::unique_ptr<ReadEngine> engine;
+    RingQueue<Chunk> chunks;
+};
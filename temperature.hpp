@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <string.h>
+
+/*
+ * \brief branchless parse of "-?d?d.d" into tenths of a degree
+ * (range -99.9..99.9)
+ *
+ * Reads the 8 bytes at s as one little-endian word. Digits have bit 4 set
+ * while '.' does not, so the lowest clear bit 4 among bytes 1..3 locates the
+ * decimal point. The digits are then shifted into fixed lanes and combined
+ * with a single multiply: 100 * d0 + 10 * d1 + d2 lands in bits 32..41.
+ * The caller must guarantee that 8 bytes are readable at s.
+ */
+inline int16_t parseTemperature(const char *s) {
+    uint64_t word;
+    memcpy(&word, s, sizeof(word));
+    const int dot = __builtin_ctzll(~word & 0x10101000);
+    const int shift = 28 - dot;
+    /* all ones when the first byte is '-' (bit 4 clear), zero for a digit */
+    const int64_t sign = int64_t(~word << 59) >> 63;
+    const uint64_t design_mask = ~uint64_t(sign & 0xFF);
+    const uint64_t digits = ((word & design_mask) << shift) & 0x0F000F0F00ull;
+    const uint64_t abs_value = ((digits * 0x640a0001) >> 32) & 0x3FF;
+    return int16_t((int64_t(abs_value) ^ sign) - sign);
+}
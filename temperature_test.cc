@@ -0,0 +1,58 @@
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#include "temperature.hpp"
+
+/*
+ * temperature_test: parseTemperature against a scalar reference for every
+ * value in -99.9..99.9, written with one or two integer digits (a leading
+ * zero where the value has only one), signed or not, and negative zero.
+ */
+
+/* \brief digit by digit, the way a text parser would */
+int16_t reference(const std::string &s) {
+    size_t i = 0;
+    const bool negative = s[i] == '-';
+    i += negative;
+    int value = 0;
+    for (; s[i] != '\n'; ++i)
+        if (s[i] != '.')
+            value = 10 * value + (s[i] - '0');
+    return int16_t(negative ? -value : value);
+}
+
+std::string format(int tenths, bool leading_zero, bool negative) {
+    const int whole = tenths / 10;
+    std::string s = negative ? "-" : "";
+    if (leading_zero && whole < 10)
+        s += "0";
+    return s + std::to_string(whole) + "." + std::to_string(tenths % 10) +
+           "\n";
+}
+
+int main() {
+    int failures = 0;
+    const auto check = [&](const std::string &row) {
+        /* the 8 readable bytes parseTemperature loads, like the padding
+         * after a chunk */
+        const std::string padded = row + std::string(8, '\0');
+        const int16_t got = parseTemperature(padded.data());
+        if (got != reference(row)) {
+            std::cout << "FAIL: " << row.substr(0, row.size() - 1) << " -> "
+                      << got << "\n";
+            ++failures;
+        }
+    };
+
+    for (int tenths = 0; tenths <= 999; ++tenths)
+        for (const bool leading_zero : {false, true})
+            for (const bool negative : {false, true})
+                check(format(tenths, leading_zero, negative));
+    /* negative zero, and a row followed by the next one */
+    check("-0.0\n");
+    check("-00.0\n");
+    check("-9.9\nAbc;1.0\n");
+    check("12.3\nX;-45.6\n");
+    return failures ? 1 : 0;
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <chrono>
+#include <sys/resource.h>
 
 class Timer {
     using Clock = std::chrono::steady_clock;
@@ -22,3 +23,23 @@ class Timer {
   private:
     TimePoint start;
 };
+
+/* \brief page faults taken by the whole process since construction */
+class FaultCounter {
+  public:
+    FaultCounter() { reset(); }
+
+    long minor() const { return now().ru_minflt - start.ru_minflt; }
+    long major() const { return now().ru_majflt - start.ru_majflt; }
+
+    void reset() { start = now(); }
+
+  private:
+    static rusage now() {
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage;
+    }
+
+    rusage start;
+};
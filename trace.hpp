@@ -0,0 +1,241 @@
+#pragma once
+
+/*
+ * Per-thread instrumentation of the pipeline stages, built only with
+ * -DONEBRC_TRACE=ON (the ONEBRC_TRACE define); otherwise every TRACE_ macro
+ * expands to nothing.
+ *
+ *   TRACE_SESSION(path)    in main: on scope exit, write the events as a
+ *                          Chrome trace-event JSON to path (if not empty)
+ *                          and a summary table to stderr
+ *   TRACE_SCOPE(name)      time the enclosing scope as stage name, a string
+ *                          literal
+ *   TRACE_COUNT(counter, n) add n to a Counter of this thread
+ *   TRACE_FAULTS()         record the page faults this thread has taken
+ *
+ * Scopes are timed with rdtsc, converted to microseconds against
+ * steady_clock over the whole session, and appended to a buffer owned by
+ * the calling thread, so recording never synchronizes. Buffers are kept in
+ * a registry until the session ends; the session must outlive the workers.
+ */
+
+#ifdef ONEBRC_TRACE
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdio.h>
+#include <string>
+#include <sys/resource.h>
+#include <vector>
+#include <x86intrin.h>
+
+namespace trace {
+
+constexpr bool ENABLED = true;
+
+enum class Counter { Chunks, Rows, Probes, Faults };
+constexpr size_t COUNTERS = 4;
+constexpr const char *COUNTER_NAMES[COUNTERS] = {"chunks", "rows", "probes",
+                                                 "faults"};
+
+struct Event {
+    const char *name;
+    uint64_t begin, end;
+};
+
+struct ThreadBuffer {
+    uint32_t tid;
+    std::vector<Event> events;
+    uint64_t counters[COUNTERS] = {};
+};
+
+class Registry {
+  public:
+    ThreadBuffer *add() {
+        std::lock_guard lk(mtx);
+        buffers.emplace_back(new ThreadBuffer{uint32_t(buffers.size()), {}});
+        buffers.back()->events.reserve(4096);
+        return buffers.back().get();
+    }
+
+    /* \brief the buffers; only once the recording threads are done */
+    const std::vector<std::unique_ptr<ThreadBuffer>> &all() const {
+        return buffers;
+    }
+
+  private:
+    std::mutex mtx;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+};
+
+inline Registry &registry() {
+    static Registry instance;
+    return instance;
+}
+
+inline ThreadBuffer &local() {
+    thread_local ThreadBuffer *buffer = registry().add();
+    return *buffer;
+}
+
+class Scope {
+  public:
+    explicit Scope(const char *name) : name(name), begin(__rdtsc()) {}
+    ~Scope() { local().events.push_back({name, begin, __rdtsc()}); }
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+  private:
+    const char *name;
+    uint64_t begin;
+};
+
+inline void countFaults() {
+    rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    local().counters[size_t(Counter::Faults)] =
+        usage.ru_minflt + usage.ru_majflt;
+}
+
+class Session {
+    using Clock = std::chrono::steady_clock;
+
+  public:
+    explicit Session(std::string path)
+        : path(std::move(path)), start_time(Clock::now()),
+          start_tsc(__rdtsc()) {
+        /* the main thread is thread 0 */
+        local();
+    }
+
+    ~Session() {
+        countFaults();
+        const double us = std::chrono::duration<double, std::micro>(
+                              Clock::now() - start_time)
+                              .count();
+        const double ticks_per_us = (__rdtsc() - start_tsc) / us;
+        if (!path.empty())
+            writeJson(ticks_per_us);
+        printSummary(ticks_per_us);
+    }
+
+    Session(const Session &) = delete;
+    Session &operator=(const Session &) = delete;
+
+  private:
+    void writeJson(double ticks_per_us) const {
+        FILE *out = fopen(path.c_str(), "w");
+        if (out == nullptr) {
+            perror(path.c_str());
+            return;
+        }
+        fprintf(out, "{\"traceEvents\": [\n");
+        const char *sep = "";
+        for (const auto &buffer : registry().all()) {
+            fprintf(out,
+                    "%s{\"name\": \"thread_name\", \"ph\": \"M\", "
+                    "\"pid\": 1, \"tid\": %u, \"args\": {\"name\": \"%s "
+                    "%u\"}}",
+                    sep, buffer->tid, buffer->tid ? "worker" : "main",
+                    buffer->tid);
+            sep = ",\n";
+            uint64_t last = start_tsc;
+            for (const Event &event : buffer->events) {
+                fprintf(out,
+                        ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, "
+                        "\"tid\": %u, \"ts\": %.3f, \"dur\": %.3f}",
+                        event.name, buffer->tid,
+                        (event.begin - start_tsc) / ticks_per_us,
+                        (event.end - event.begin) / ticks_per_us);
+                last = std::max(last, event.end);
+            }
+            fprintf(out,
+                    ",\n{\"name\": \"counters\", \"ph\": \"C\", \"pid\": 1, "
+                    "\"tid\": %u, \"ts\": %.3f, \"args\": {",
+                    buffer->tid, (last - start_tsc) / ticks_per_us);
+            for (size_t i = 0; i < COUNTERS; ++i)
+                fprintf(out, "%s\"%s\": %llu", i ? ", " : "",
+                        COUNTER_NAMES[i],
+                        (unsigned long long)buffer->counters[i]);
+            fprintf(out, "}}");
+        }
+        fprintf(out, "\n]}\n");
+        if (fclose(out) != 0)
+            perror(path.c_str());
+    }
+
+    void printSummary(double ticks_per_us) const {
+        struct Stage {
+            uint64_t count = 0, ticks = 0, max = 0;
+        };
+        std::map<std::string, Stage> stages;
+        for (const auto &buffer : registry().all()) {
+            for (const Event &event : buffer->events) {
+                Stage &stage = stages[event.name];
+                const uint64_t ticks = event.end - event.begin;
+                ++stage.count;
+                stage.ticks += ticks;
+                stage.max = std::max(stage.max, ticks);
+            }
+        }
+
+        fprintf(stderr, "%-12s %10s %12s %12s %12s\n", "stage", "count",
+                "total ms", "mean us", "max us");
+        for (const auto &[name, stage] : stages)
+            fprintf(stderr, "%-12s %10llu %12.3f %12.3f %12.3f\n",
+                    name.c_str(), (unsigned long long)stage.count,
+                    stage.ticks / ticks_per_us / 1000,
+                    stage.ticks / ticks_per_us / stage.count,
+                    stage.max / ticks_per_us);
+
+        fprintf(stderr, "%-12s", "thread");
+        for (const char *name : COUNTER_NAMES)
+            fprintf(stderr, " %12s", name);
+        fprintf(stderr, " %12s\n", "probes/row");
+        for (const auto &buffer : registry().all()) {
+            const uint64_t *counters = buffer->counters;
+            fprintf(stderr, "%-12u", buffer->tid);
+            for (size_t i = 0; i < COUNTERS; ++i)
+                fprintf(stderr, " %12llu", (unsigned long long)counters[i]);
+            const uint64_t rows = counters[size_t(Counter::Rows)];
+            fprintf(stderr, " %12.3f\n",
+                    rows ? double(counters[size_t(Counter::Probes)]) / rows
+                         : 0.0);
+        }
+    }
+
+    std::string path;
+    Clock::time_point start_time;
+    uint64_t start_tsc;
+};
+
+} // namespace trace
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#define TRACE_SESSION(path)                                                   \
+    const trace::Session TRACE_CONCAT(trace_session_, __LINE__)(path)
+#define TRACE_SCOPE(name)                                                     \
+    const trace::Scope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#define TRACE_COUNT(counter, n)                                               \
+    (trace::local().counters[size_t(trace::Counter::counter)] += (n))
+#define TRACE_FAULTS() trace::countFaults()
+
+#else
+
+namespace trace {
+constexpr bool ENABLED = false;
+}
+
+#define TRACE_SESSION(path)
+#define TRACE_SCOPE(name)
+#define TRACE_COUNT(counter, n)
+#define TRACE_FAULTS()
+
+#endif